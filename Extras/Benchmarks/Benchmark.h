@@ -0,0 +1,79 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../../JuceLibraryCode/JuceHeader.h"
+
+#include <cstdio>
+
+//==============================================================================
+/** Timing shared by the benchmarks, each one is a small program of its own. */
+struct Benchmark
+{
+    /** Calls the function until at least minimumSeconds have passed, returns the mean time of a call in milliseconds. */
+    template <typename Function>
+    static double measure(Function&& function, double minimumSeconds = 0.5)
+    {
+        // the first call warms the caches and isn't counted
+        function();
+
+        int numCalls = 0;
+        const int64 start = Time::getHighResolutionTicks();
+        int64 elapsed = 0;
+
+        do
+        {
+            function();
+            ++numCalls;
+            elapsed = Time::getHighResolutionTicks() - start;
+        }
+        while (Time::highResolutionTicksToSeconds(elapsed) < minimumSeconds);
+
+        return Time::highResolutionTicksToSeconds(elapsed) * 1000.0 / numCalls;
+    }
+
+    static void printHeader(const String& title)
+    {
+        std::printf("\n%s\n", title.toRawUTF8());
+    }
+
+    static void printResult(const String& name, double milliseconds, double bytes = 0)
+    {
+        if (bytes > 0)
+            std::printf("  %-44s %12.4f ms %10.1f MB/s\n", name.toRawUTF8(), milliseconds, bytes / (milliseconds * 1000.0));
+        else
+            std::printf("  %-44s %12.4f ms\n", name.toRawUTF8(), milliseconds);
+    }
+};
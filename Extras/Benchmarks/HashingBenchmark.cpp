@@ -0,0 +1,168 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#include "Benchmark.h"
+#include "../../Source/Hashing.h"
+
+#include <sys/stat.h>
+
+/*  Change detection of the sources of a compile.
+
+    Before, every compile took the MD5 of the cached copy of a source and of the
+    file itself. Now the first compile of a version hashes the file once with
+    FastHash, later ones only stat it and compare with what was remembered.
+
+    Usage: HashingBenchmark <file or folder> ...
+    A folder is concatenated into one file first, so a JUCE module folder gives
+    a source the size of the module once its .cpp has included everything.
+*/
+
+//==============================================================================
+struct FileStatus
+{
+    int64 modificationTime;
+    int64 size;
+    uint64 identity;
+};
+
+static bool getFileStatus(const File& file, FileStatus& status)
+{
+    struct stat info;
+    if (::stat(file.getFullPathName().toRawUTF8(), &info) != 0 || ! S_ISREG(info.st_mode))
+        return false;
+
+    status.modificationTime = (int64) info.st_mtime;
+    status.size = (int64) info.st_size;
+    status.identity = (uint64) info.st_ino;
+    return true;
+}
+
+static void amalgamate(const File& folder, const File& target)
+{
+    MemoryOutputStream text;
+
+    DirectoryIterator it(folder, true, "*.cpp;*.mm;*.h");
+    while (it.next())
+    {
+        MemoryBlock data;
+        if (it.getFile().loadFileAsData(data))
+            text << data;
+    }
+
+    target.replaceWithData(text.getData(), text.getDataSize());
+}
+
+//==============================================================================
+static void benchmarkFile(const File& file, const String& name)
+{
+    const int64 size = file.getSize();
+    Benchmark::printHeader(name + ", " + File::descriptionOfSizeInBytes(size));
+
+    // the old path read a copy of the source kept in the cache folder as well
+    TemporaryFile cachedCopy(file);
+    file.copyFileTo(cachedCopy.getFile());
+
+    String result;
+
+    Benchmark::printResult("MD5 of the cached copy and the file", Benchmark::measure([&] {
+        result = MD5(cachedCopy.getFile()).toHexString() + MD5(file).toHexString();
+    }), 2.0 * size);
+
+    Benchmark::printResult("FastHash::forFile, a new version", Benchmark::measure([&] {
+        result = FastHash::forFile(file);
+    }), (double) size);
+
+    FileStatus remembered;
+    getFileStatus(file, remembered);
+    const String rememberedHash(FastHash::forFile(file));
+
+    Benchmark::printResult("stat against the remembered hash", Benchmark::measure([&] {
+        FileStatus status;
+        if (getFileStatus(file, status)
+            && status.modificationTime == remembered.modificationTime
+            && status.size == remembered.size
+            && status.identity == remembered.identity)
+        {
+            result = rememberedHash;
+        }
+        else
+        {
+            result = FastHash::forFile(file);
+        }
+    }));
+
+    // the text of an open document is hashed in memory, once per version
+    MemoryBlock text;
+    file.loadFileAsData(text);
+
+    Benchmark::printResult("MD5 of the text in memory", Benchmark::measure([&] {
+        result = MD5(text.getData(), text.getSize()).toHexString();
+    }), (double) size);
+
+    Benchmark::printResult("FastHash of the text in memory", Benchmark::measure([&] {
+        result = FastHash::toHexString(text.getData(), text.getSize());
+    }), (double) size);
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::printf("usage: %s <file or folder> ...\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        const File input(File::getCurrentWorkingDirectory().getChildFile(String(argv[i])));
+
+        if (input.isDirectory())
+        {
+            TemporaryFile amalgamated(input.getFileName() + ".cpp");
+            amalgamate(input, amalgamated.getFile());
+            benchmarkFile(amalgamated.getFile(), input.getFileName() + " amalgamated");
+        }
+        else if (input.existsAsFile())
+        {
+            benchmarkFile(input, input.getFileName());
+        }
+        else
+        {
+            std::printf("%s not found\n", argv[i]);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#include "Benchmark.h"
+#include "../../Source/SharedQueue.h"
+
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*  Contention of the queue feeding the builder's message thread.
+
+    Producers push events as fast as they can while the one consumer takes them,
+    the way the Projucer callbacks and the compile jobs post to the builder.
+    MutexQueue is the queue used before: a std::queue behind a mutex, copying on
+    push and pop and notifying on every push, popped one event at a time.
+
+    Usage: QueueBenchmark [events], 1000000 by default
+*/
+
+//==============================================================================
+template <typename T>
+class MutexQueue
+{
+public:
+    void push(T value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            objectQueue.push(value);
+        }
+
+        conditionVariable.notify_one();
+    }
+
+    void waitAndPop(T& returnValue)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        conditionVariable.wait(lock, [&]() {
+            return ! objectQueue.empty();
+        });
+
+        returnValue = objectQueue.front();
+        objectQueue.pop();
+    }
+
+private:
+    std::mutex mutex;
+    std::queue<T> objectQueue;
+    std::condition_variable conditionVariable;
+};
+
+//==============================================================================
+template <typename PushFunction, typename ConsumeFunction>
+static double run(int numProducers, int numEvents, PushFunction push, ConsumeFunction consume)
+{
+    const int eventsPerProducer = numEvents / numProducers;
+    const int64 start = Time::getHighResolutionTicks();
+
+    std::vector<std::thread> producers;
+    for (int i = 0; i < numProducers; i++)
+    {
+        producers.emplace_back([&push, eventsPerProducer] {
+            for (int event = 0; event < eventsPerProducer; event++)
+                push(event);
+        });
+    }
+
+    consume(eventsPerProducer * numProducers);
+
+    for (auto& producer : producers)
+        producer.join();
+
+    return Time::highResolutionTicksToSeconds(Time::getHighResolutionTicks() - start) * 1000.0;
+}
+
+static void printRun(const String& name, int numEvents, double milliseconds)
+{
+    std::printf("  %-44s %12.2f ms %10.2f M events/s\n", name.toRawUTF8(), milliseconds, numEvents / (milliseconds * 1000.0));
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    const int numEvents = argc > 1 ? jmax(1000, String(argv[1]).getIntValue()) : 1000000;
+
+    for (int numProducers = 1; numProducers <= 32; numProducers *= 2)
+    {
+        Benchmark::printHeader(String(numProducers) + (numProducers == 1 ? " producer" : " producers"));
+
+        {
+            MutexQueue<int> queue;
+
+            const double milliseconds = run(numProducers, numEvents,
+                                            [&queue] (int event) { queue.push(event); },
+                                            [&queue] (int numToTake) {
+                                                int event;
+                                                for (int i = 0; i < numToTake; i++)
+                                                    queue.waitAndPop(event);
+                                            });
+
+            printRun("MutexQueue, one pop per event", numEvents, milliseconds);
+        }
+
+        {
+            SharedQueue<int> queue;
+
+            const double milliseconds = run(numProducers, numEvents,
+                                            [&queue] (int event) { queue.push(std::move(event)); },
+                                            [&queue] (int numToTake) {
+                                                std::vector<int> events;
+                                                events.reserve((size_t) numToTake);
+                                                while (events.size() < (size_t) numToTake)
+                                                    queue.waitAndDrainInto(events);
+                                            });
+
+            printRun("SharedQueue, drained in batches", numEvents, milliseconds);
+            std::printf("  %-44s %12d\n", "  most events waiting at once", (int) queue.getStatistics().highWaterMark);
+        }
+
+        {
+            // a bounded queue refuses what doesn't fit, the producers retry
+            SharedQueue<int> queue(1024);
+
+            const double milliseconds = run(numProducers, numEvents,
+                                            [&queue] (int event) {
+                                                while (! queue.push(std::move(event)))
+                                                    std::this_thread::yield();
+                                            },
+                                            [&queue] (int numToTake) {
+                                                std::vector<int> events;
+                                                events.reserve((size_t) numToTake);
+                                                while (events.size() < (size_t) numToTake)
+                                                    queue.waitAndDrainInto(events);
+                                            });
+
+            printRun("SharedQueue of 1024, drained in batches", numEvents, milliseconds);
+            std::printf("  %-44s %12d\n", "  pushes refused", (int) queue.getStatistics().numRejected);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#include "Benchmark.h"
+
+// the view and the shared text buffer are built in, they don't need the rest of the engine
+#include "../../Source/ValueTreeView.cpp"
+#include "../../Source/LiveDocument.cpp"
+
+/*  Decoding of the messages the Projucer sends while a file is edited.
+
+    Before, every message went through ValueTree::readFromData and the text was
+    copied out of the tree into a String. Now the message is read in place with
+    ValueTreeView and the text copied once, into the SourceBuffer the document
+    and the compiler share.
+
+    This measures the decoding that projucer_sendMessage does before handing
+    over to the builder, the builder itself needs LLVM and isn't part of it.
+
+    Usage: ValueTreeViewBenchmark [megabytes ...], 1 4 16 by default
+*/
+
+//==============================================================================
+static const Identifier fileId("file");
+static const Identifier textId("text");
+static const Identifier startId("start");
+static const Identifier endId("end");
+
+static MemoryBlock serialise(const ValueTree& message)
+{
+    MemoryOutputStream stream;
+    message.writeToStream(stream);
+    return stream.getMemoryBlock();
+}
+
+static String makeSource(int64 numBytes)
+{
+    MemoryOutputStream text;
+    for (int line = 0; text.getDataSize() < (size_t) numBytes; line++)
+        text << "    const String text" << line << " (\"a line of an amalgamated source\");\n";
+
+    return text.toString();
+}
+
+//==============================================================================
+static void benchmarkFileUpdate(int megabytes)
+{
+    const String text(makeSource((int64) megabytes * 1024 * 1024));
+
+    ValueTree message(MessageTypes::LIVE_FILE_UPDATE);
+    message.setProperty(fileId, "/project/Source/MainComponent.cpp", nullptr);
+    message.setProperty(textId, text, nullptr);
+
+    const MemoryBlock data(serialise(message));
+    const double size = (double) data.getSize();
+
+    Benchmark::printHeader("LIVE_FILE_UPDATE, " + File::descriptionOfSizeInBytes((int64) data.getSize()));
+
+    Benchmark::printResult("ValueTree::readFromData and String", Benchmark::measure([&] {
+        const ValueTree tree(ValueTree::readFromData(data.getData(), data.getSize()));
+        const String file(tree.getProperty(fileId).toString());
+        const String fileText(tree.getProperty(textId).toString());
+        jassert(fileText.isNotEmpty());
+    }), size);
+
+    Benchmark::printResult("ValueTreeView and SourceBuffer", Benchmark::measure([&] {
+        const ValueTreeView view(data.getData(), data.getSize());
+
+        const char* fileText = "";
+        size_t numBytes = 0;
+        view.getStringProperty(textId, fileText, numBytes);
+
+        const String file(view.getStringProperty(fileId));
+        const SourceBuffer::Ptr buffer(new SourceBuffer(fileText, numBytes));
+        jassert(buffer->getSize() > 0);
+    }), size);
+}
+
+static void benchmarkFileChanges(int numChanges)
+{
+    ValueTree message(MessageTypes::LIVE_FILE_CHANGES);
+    message.setProperty(fileId, "/project/Source/MainComponent.cpp", nullptr);
+
+    for (int i = 0; i < numChanges; i++)
+    {
+        ValueTree change(MessageTypes::CHANGE);
+        change.setProperty(startId, i * 10, nullptr);
+        change.setProperty(endId, i * 10 + 1, nullptr);
+        change.setProperty(textId, "x", nullptr);
+        message.addChild(change, -1, nullptr);
+    }
+
+    const MemoryBlock data(serialise(message));
+
+    Benchmark::printHeader("LIVE_FILE_CHANGES, " + String(numChanges) + " changes");
+
+    Benchmark::printResult("ValueTree::readFromData and String", Benchmark::measure([&] {
+        const ValueTree tree(ValueTree::readFromData(data.getData(), data.getSize()));
+
+        Array<String> texts;
+        for (int i = 0; i < tree.getNumChildren(); i++)
+            texts.add(tree.getChild(i).getProperty(textId).toString());
+    }));
+
+    Benchmark::printResult("ValueTreeView", Benchmark::measure([&] {
+        const ValueTreeView view(data.getData(), data.getSize());
+
+        Array<LiveCodeChange> changes;
+        for (int i = 0; i < view.getNumChildren(); i++)
+        {
+            const ValueTreeView& child = view.getChild(i);
+            LiveCodeChange change = { child.getIntProperty(startId, 0), child.getIntProperty(endId, 0), "", 0 };
+            child.getStringProperty(textId, change.text, change.numBytes);
+            changes.add(change);
+        }
+    }));
+}
+
+static void benchmarkTypeCheck()
+{
+    const MemoryBlock data(serialise(ValueTree(MessageTypes::PING)));
+
+    Benchmark::printHeader("PING");
+
+    Benchmark::printResult("ValueTree::readFromData", Benchmark::measure([&] {
+        const ValueTree tree(ValueTree::readFromData(data.getData(), data.getSize()));
+        jassert(tree.hasType(MessageTypes::PING));
+    }));
+
+    Benchmark::printResult("ValueTreeView", Benchmark::measure([&] {
+        const ValueTreeView view(data.getData(), data.getSize());
+        jassert(view.hasType(MessageTypes::PING));
+    }));
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    Array<int> sizes;
+    for (int i = 1; i < argc; i++)
+        sizes.add(jmax(1, String(argv[i]).getIntValue()));
+
+    if (sizes.isEmpty())
+    {
+        sizes.add(1);
+        sizes.add(4);
+        sizes.add(16);
+    }
+
+    for (int megabytes : sizes)
+        benchmarkFileUpdate(megabytes);
+
+    benchmarkFileChanges(10);
+    benchmarkFileChanges(1000);
+    benchmarkTypeCheck();
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Builds the benchmarks against the JUCE modules only, LLVM isn't needed.
+# Usage: ./build.sh [name ...], all of them when no name is given, the binaries go to build/
+
+cd "$(dirname "$0")"
+
+JUCE_MODULES="../../../JUCE/modules"
+LIBRARY_CODE="../../JuceLibraryCode"
+MODULES="juce_core juce_cryptography juce_data_structures juce_events"
+
+if [ "$(uname)" == "Darwin" ]; then
+	EXTENSION="mm"
+	LIBRARIES="-framework Cocoa -framework IOKit"
+else
+	EXTENSION="cpp"
+	LIBRARIES="-lpthread -ldl -lrt -lX11"
+fi
+
+FLAGS="-std=c++14 -O3 -DNDEBUG -I${JUCE_MODULES} -I${LIBRARY_CODE}"
+
+BENCHMARKS="$@"
+if [ -z "${BENCHMARKS}" ]; then
+	BENCHMARKS=$(ls *.cpp | sed 's/\.cpp$//')
+fi
+
+mkdir -p build/juce
+
+# the modules are compiled once and shared by every benchmark
+OBJECTS=""
+for MODULE in ${MODULES}; do
+	OBJECT="build/juce/${MODULE}.o"
+	if [ ! -f "${OBJECT}" ]; then
+		c++ ${FLAGS} -c "${LIBRARY_CODE}/${MODULE}.${EXTENSION}" -o "${OBJECT}" || exit 1
+	fi
+	OBJECTS="${OBJECTS} ${OBJECT}"
+done
+
+for BENCHMARK in ${BENCHMARKS}; do
+	c++ ${FLAGS} "${BENCHMARK}.cpp" ${OBJECTS} ${LIBRARIES} -o "build/${BENCHMARK}" || exit 1
+done
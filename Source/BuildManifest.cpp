@@ -0,0 +1,178 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#include "BuildManifest.h"
+
+//==============================================================================
+BuildManifest::BuildManifest(const File& cacheFolder_)
+    : cacheFolder(cacheFolder_),
+      manifestFile(cacheFolder_.getChildFile("manifest.bin"))
+{
+}
+
+bool BuildManifest::load()
+{
+    MemoryMappedFile mapping(manifestFile, MemoryMappedFile::readOnly);
+    if (mapping.getData() == nullptr)
+        return false;
+
+    MemoryInputStream input(mapping.getData(), mapping.getSize(), false);
+    if (input.readInt() != magic || input.readInt() != version)
+        return false;
+
+    std::map<String, Unit> loadedUnits;
+
+    for (int i = input.readInt(); i > 0; --i)
+    {
+        if (input.isExhausted())
+            return false;
+
+        const String unitPath(input.readString());
+
+        Unit& unit = loadedUnits[unitPath];
+        unit.sourceHash = input.readString();
+        unit.flagsHash = input.readString();
+        unit.fastKey = input.readString();
+        unit.optimisedKey = input.readString();
+        unit.isOptimised = input.readBool();
+        unit.compileMilliseconds = (uint32) input.readInt();
+        unit.bitcodeFile = input.readString();
+        unit.objectFile = input.readString();
+
+        for (int j = input.readInt(); j > 0 && ! input.isExhausted(); --j)
+            unit.dependencies.add(input.readString());
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    units.swap(loadedUnits);
+    hasChanged = false;
+    return true;
+}
+
+bool BuildManifest::save()
+{
+    MemoryOutputStream output;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (! hasChanged)
+            return true;
+
+        output.writeInt(magic);
+        output.writeInt(version);
+        output.writeInt((int) units.size());
+
+        for (auto& entry : units)
+        {
+            const Unit& unit = entry.second;
+
+            output.writeString(entry.first);
+            output.writeString(unit.sourceHash);
+            output.writeString(unit.flagsHash);
+            output.writeString(unit.fastKey);
+            output.writeString(unit.optimisedKey);
+            output.writeBool(unit.isOptimised);
+            output.writeInt((int) unit.compileMilliseconds);
+            output.writeString(unit.bitcodeFile);
+            output.writeString(unit.objectFile);
+
+            output.writeInt(unit.dependencies.size());
+            for (int i = 0; i < unit.dependencies.size(); i++)
+                output.writeString(unit.dependencies.getReference(i));
+        }
+
+        hasChanged = false;
+    }
+
+    // written next to the manifest and renamed over it, readers see the old or the new one
+    cacheFolder.createDirectory();
+
+    TemporaryFile temporary(manifestFile, TemporaryFile::useHiddenFile);
+    if (! temporary.getFile().replaceWithData(output.getData(), output.getDataSize()))
+        return false;
+
+    return temporary.overwriteTargetFileWithTemporary();
+}
+
+void BuildManifest::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    units.clear();
+    hasChanged = true;
+}
+
+//==============================================================================
+bool BuildManifest::getUnit(const String& unitPath, Unit& unit) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = units.find(unitPath);
+    if (it == units.end())
+        return false;
+
+    unit = it->second;
+    return true;
+}
+
+uint32 BuildManifest::getCompileMilliseconds(const String& unitPath) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = units.find(unitPath);
+    return it != units.end() ? it->second.compileMilliseconds : 0;
+}
+
+bool BuildManifest::getOptimisedKey(const String& unitPath, String& key) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = units.find(unitPath);
+    if (it == units.end() || ! it->second.isOptimised || it->second.optimisedKey.isEmpty())
+        return false;
+
+    key = it->second.optimisedKey;
+    return true;
+}
+
+StringArray BuildManifest::getUnitPaths() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    StringArray paths;
+    for (auto& entry : units)
+        paths.add(entry.first);
+
+    return paths;
+}
@@ -0,0 +1,103 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "Common.h"
+
+//==============================================================================
+/** Index of the cache folder, what the last compile of every unit produced.
+
+    Kept in one versioned binary file that is mapped when read and replaced in a
+    single rename when written, so a crash never leaves half an index behind.
+    A missing, foreign or outdated file simply reads as an empty manifest.
+*/
+class BuildManifest
+{
+public:
+    struct Unit
+    {
+        String sourceHash;
+        String flagsHash;
+        String fastKey;             // cache key of the bitcode at -O0
+        String optimisedKey;        // cache key of the bitcode at -O2, empty until the unit was optimised
+        bool isOptimised = false;   // which of the two was loaded last
+        SortedSet<String> dependencies;
+        uint32 compileMilliseconds = 0;
+        String bitcodeFile;         // relative to the cache folder
+        String objectFile;          // relative to the cache folder, empty until code was generated
+
+        const String& getKey() const noexcept { return isOptimised ? optimisedKey : fastKey; }
+    };
+
+    explicit BuildManifest(const File& cacheFolder);
+
+    bool load();
+    bool save();
+    void clear();
+
+    bool getUnit(const String& unitPath, Unit& unit) const;
+    StringArray getUnitPaths() const;
+
+    /** How long the last real compile of a unit took, 0 when it never was compiled. */
+    uint32 getCompileMilliseconds(const String& unitPath) const;
+
+    /** The -O2 key of a unit whose optimised bitcode was the last one loaded. */
+    bool getOptimisedKey(const String& unitPath, String& key) const;
+
+    /** Changes the entry of a unit in place, creating it if needed. */
+    template <typename UpdateFunction>
+    void updateUnit(const String& unitPath, UpdateFunction update)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        update(units[unitPath]);
+        hasChanged = true;
+    }
+
+    File getFile() const { return manifestFile; }
+
+private:
+    static const int magic = 0x4e414d31; // 'MAN1'
+    static const int version = 2;
+
+    File cacheFolder;
+    File manifestFile;
+
+    mutable std::mutex mutex;
+    std::map<String, Unit> units;
+    bool hasChanged = false;
+
+    JUCE_DECLARE_NON_COPYABLE(BuildManifest)
+};
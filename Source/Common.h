@@ -37,15 +37,16 @@
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "../../JUCE/extras/Projucer/Source/Utility/jucer_PresetIDs.h"
 #include "../../JUCE/extras/Projucer/Source/LiveBuildEngine/projucer_MessageIDs.h"
+#include "Log.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <string>
 #include <mutex>
 
-//==============================================================================
-#define LOG(x) do { String s; s << x; s << newLine; Logger::writeToLog(s); } while(false)
-
 //==============================================================================
 extern "C"
 {
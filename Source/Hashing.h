@@ -0,0 +1,181 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "Common.h"
+
+//==============================================================================
+/** Fast non-cryptographic hashing used for change detection and cache keys.
+
+    This is XXH64; the 128 bit digests are made of two passes with different
+    seeds, which is still several times faster than MD5 on large sources.
+*/
+struct FastHash
+{
+    static uint64 compute(const void* data, size_t numBytes, uint64 seed = 0) noexcept
+    {
+        const uint8* p = static_cast<const uint8*>(data);
+        const uint8* const end = p + numBytes;
+        uint64 h;
+
+        if (numBytes >= 32)
+        {
+            const uint8* const limit = end - 32;
+            uint64 v1 = seed + prime1 + prime2;
+            uint64 v2 = seed + prime2;
+            uint64 v3 = seed;
+            uint64 v4 = seed - prime1;
+
+            do
+            {
+                v1 = round(v1, read64(p)); p += 8;
+                v2 = round(v2, read64(p)); p += 8;
+                v3 = round(v3, read64(p)); p += 8;
+                v4 = round(v4, read64(p)); p += 8;
+            }
+            while (p <= limit);
+
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = mergeRound(h, v1);
+            h = mergeRound(h, v2);
+            h = mergeRound(h, v3);
+            h = mergeRound(h, v4);
+        }
+        else
+        {
+            h = seed + prime5;
+        }
+
+        h += (uint64) numBytes;
+
+        while (p + 8 <= end)
+        {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * prime1 + prime4;
+            p += 8;
+        }
+
+        if (p + 4 <= end)
+        {
+            h ^= (uint64) read32(p) * prime1;
+            h = rotl(h, 23) * prime2 + prime3;
+            p += 4;
+        }
+
+        while (p < end)
+        {
+            h ^= (*p++) * prime5;
+            h = rotl(h, 11) * prime1;
+        }
+
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+
+        return h;
+    }
+
+    /** Returns a 128 bit digest as 32 hex characters. */
+    static String toHexString(const void* data, size_t numBytes)
+    {
+        return String::toHexString((int64) compute(data, numBytes, 0)).paddedLeft('0', 16)
+             + String::toHexString((int64) compute(data, numBytes, prime1)).paddedLeft('0', 16);
+    }
+
+    /** Hashes a file through a read-only mapping rather than a heap copy. */
+    static String forFile(const File& file)
+    {
+        MemoryMappedFile mappedFile(file, MemoryMappedFile::readOnly);
+        if (mappedFile.getData() != nullptr)
+            return toHexString(mappedFile.getData(), mappedFile.getSize());
+
+        MemoryBlock data;
+        if (file.loadFileAsData(data))
+            return toHexString(data.getData(), data.getSize());
+
+        return String();
+    }
+
+private:
+    static const uint64 prime1 = 11400714785074694791ULL;
+    static const uint64 prime2 = 14029467366897019727ULL;
+    static const uint64 prime3 = 1609587929392839161ULL;
+    static const uint64 prime4 = 9650029242287828579ULL;
+    static const uint64 prime5 = 2870177450012600261ULL;
+
+    static inline uint64 rotl(uint64 value, int bits) noexcept
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    static inline uint64 round(uint64 accumulator, uint64 input) noexcept
+    {
+        accumulator += input * prime2;
+        accumulator = rotl(accumulator, 31);
+        return accumulator * prime1;
+    }
+
+    static inline uint64 mergeRound(uint64 accumulator, uint64 value) noexcept
+    {
+        accumulator ^= round(0, value);
+        return accumulator * prime1 + prime4;
+    }
+
+    static inline uint64 read64(const uint8* p) noexcept
+    {
+        uint64 value;
+        memcpy(&value, p, sizeof(value));
+        return ByteOrder::swapIfBigEndian(value);
+    }
+
+    static inline uint32 read32(const uint8* p) noexcept
+    {
+        uint32 value;
+        memcpy(&value, p, sizeof(value));
+        return ByteOrder::swapIfBigEndian(value);
+    }
+};
+
+//==============================================================================
+/** Lets juce::String be used as the key of the standard unordered containers. */
+struct StringHash
+{
+    size_t operator()(const String& text) const noexcept
+    {
+        return (size_t) text.hashCode64();
+    }
+};
@@ -0,0 +1,298 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#include "JobScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+//==============================================================================
+SchedulerJob::SchedulerJob(const String& name)
+    : jobName(name)
+{
+}
+
+SchedulerJob::~SchedulerJob()
+{
+}
+
+//==============================================================================
+class JobScheduler::WorkerThread : public Thread
+{
+public:
+    WorkerThread(JobScheduler& owner_)
+        : Thread("Job Scheduler Thread"),
+          owner(owner_)
+    {
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            if (SchedulerJob* job = owner.waitForNextJob(*this))
+                owner.finishJob(job, job->runJob());
+        }
+    }
+
+private:
+    JobScheduler& owner;
+};
+
+//==============================================================================
+JobScheduler::JobScheduler(int numberOfThreads)
+    : maxIdleJobs(jmax(1, numberOfThreads - 1))
+{
+    // with a single thread asked for there is one more, kept for whatever isn't idle
+    for (int i = maxIdleJobs + 1; --i >= 0;)
+        threads.add(new WorkerThread(*this))->startThread();
+}
+
+JobScheduler::~JobScheduler()
+{
+    stop(5000);
+}
+
+void JobScheduler::addJob(SchedulerJob* job, JobPriority priority, uint32 notBefore)
+{
+    jassert(job != nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        job->priority = priority;
+        job->sequence = nextSequence++;
+        job->notBefore = notBefore;
+        job->shouldStop = false;
+        jobs.emplace_back(job);
+    }
+
+    jobsCondition.notify_one();
+}
+
+void JobScheduler::raisePriority(SchedulerJob* job, JobPriority priority)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& queued : jobs)
+    {
+        if (queued.get() == job)
+        {
+            if (priority < job->priority)
+                job->priority = priority;
+
+            return;
+        }
+    }
+}
+
+bool JobScheduler::setStartTime(SchedulerJob* job, uint32 notBefore)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = std::find_if(jobs.begin(), jobs.end(), [job] (const std::unique_ptr<SchedulerJob>& queued) {
+            return queued.get() == job;
+        });
+
+        if (it == jobs.end() || job->isActive)
+            return false;
+
+        job->notBefore = notBefore;
+    }
+
+    // an earlier start may be due right away, the waiting threads work out their timeout again
+    jobsCondition.notify_all();
+    return true;
+}
+
+bool JobScheduler::removeAllJobs(int timeOutMs)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [] (const std::unique_ptr<SchedulerJob>& job) {
+        return ! job->isActive;
+    }), jobs.end());
+
+    for (auto& job : jobs)
+    {
+        if (! job->shouldStop.exchange(true))
+            job->exitRequested();
+    }
+
+    return finishedCondition.wait_for(lock, std::chrono::milliseconds(timeOutMs), [this] () {
+        return jobs.empty();
+    });
+}
+
+void JobScheduler::stop(int timeOutMs)
+{
+    removeAllJobs(timeOutMs);
+
+    for (auto* thread : threads)
+        thread->signalThreadShouldExit();
+
+    jobsCondition.notify_all();
+
+    for (auto* thread : threads)
+        thread->stopThread(timeOutMs);
+
+    threads.clear();
+}
+
+bool JobScheduler::containsJobNamed(const String& name) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& job : jobs)
+        if (job->jobName == name)
+            return true;
+
+    return false;
+}
+
+StringArray JobScheduler::getNamesOfAllJobs() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // a job waiting for its start time isn't doing anything yet
+    const uint32 now = Time::getMillisecondCounter();
+
+    std::vector<const SchedulerJob*> ordered;
+    for (auto& job : jobs)
+        if (job->isActive || ! isDelayed(job.get(), now))
+            ordered.push_back(job.get());
+
+    std::sort(ordered.begin(), ordered.end(), [] (const SchedulerJob* first, const SchedulerJob* second) {
+        if (first->isActive != second->isActive)
+            return first->isActive;
+
+        return runsBefore(first, second);
+    });
+
+    StringArray names;
+    for (auto* job : ordered)
+        names.add(job->jobName);
+
+    return names;
+}
+
+//==============================================================================
+SchedulerJob* JobScheduler::waitForNextJob(Thread& thread)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (;;)
+    {
+        if (thread.threadShouldExit())
+            return nullptr;
+
+        // the priority classes are few and the queue short, a scan beats keeping a heap in sync
+        const uint32 now = Time::getMillisecondCounter();
+        int timeoutMs = 500;
+
+        int numIdleJobsRunning = 0;
+        for (auto& job : jobs)
+            if (job->isActive && job->priority == JobPriority::Idle)
+                ++numIdleJobsRunning;
+
+        SchedulerJob* next = nullptr;
+        for (auto& job : jobs)
+        {
+            if (job->isActive || (job->priority == JobPriority::Idle && numIdleJobsRunning >= maxIdleJobs))
+                continue;
+
+            // the thread wakes up again for the first delayed job to become due
+            if (isDelayed(job.get(), now))
+            {
+                timeoutMs = jmin(timeoutMs, (int) (job->notBefore - now));
+                continue;
+            }
+
+            if (next == nullptr || runsBefore(job.get(), next))
+                next = job.get();
+        }
+
+        if (next != nullptr)
+        {
+            next->isActive = true;
+            return next;
+        }
+
+        jobsCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs));
+    }
+}
+
+void JobScheduler::finishJob(SchedulerJob* job, SchedulerJob::JobStatus status)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = std::find_if(jobs.begin(), jobs.end(), [job] (const std::unique_ptr<SchedulerJob>& queued) {
+            return queued.get() == job;
+        });
+
+        jassert(it != jobs.end());
+
+        // a job asking to run again goes back behind the others of its priority
+        if (status == SchedulerJob::jobNeedsRunningAgain && ! job->shouldExit())
+        {
+            job->isActive = false;
+            job->sequence = nextSequence++;
+            job->notBefore = job->restartTime;
+            job->restartTime = 0;
+        }
+        else
+        {
+            jobs.erase(it);
+        }
+    }
+
+    jobsCondition.notify_one();
+    finishedCondition.notify_all();
+}
+
+bool JobScheduler::isDelayed(const SchedulerJob* job, uint32 now)
+{
+    // the millisecond counter wraps, the difference tells which side of now the start is
+    return job->notBefore != 0 && (int) (job->notBefore - now) > 0;
+}
+
+bool JobScheduler::runsBefore(const SchedulerJob* first, const SchedulerJob* second)
+{
+    if (first->priority != second->priority)
+        return first->priority < second->priority;
+
+    return first->sequence < second->sequence;
+}
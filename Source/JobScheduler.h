@@ -0,0 +1,155 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "Common.h"
+
+#include <vector>
+
+//==============================================================================
+/** Order in which queued jobs are picked up, the interactive ones first. */
+enum class JobPriority
+{
+    Interactive,    // edits coming from the editor and what they wait on
+    Dependent,      // units including a header that was edited
+    Background,     // the rest of the project and housekeeping
+    Idle            // work that only pays off later, like optimising what already runs
+};
+
+//==============================================================================
+/** A unit of work run by the JobScheduler, shaped after juce::ThreadPoolJob. */
+class SchedulerJob
+{
+public:
+    enum JobStatus
+    {
+        jobHasFinished = 0,
+        jobNeedsRunningAgain
+    };
+
+    explicit SchedulerJob(const String& name);
+    virtual ~SchedulerJob();
+
+    const String& getJobName() const noexcept { return jobName; }
+
+    virtual JobStatus runJob() = 0;
+
+    /** True once the scheduler wants the job to stop as soon as it can. */
+    bool shouldExit() const noexcept { return shouldStop.load(); }
+
+protected:
+    /** Called by the scheduler when it asks the job to exit, lets a job stop work that doesn't poll shouldExit().
+        Called with the scheduler locked, it must not call back into the scheduler.
+    */
+    virtual void exitRequested() {}
+
+    /** Called before returning jobNeedsRunningAgain, the job waits in the queue without a thread until then. */
+    void runAgainAfter(int delayMs) noexcept { restartTime = Time::getMillisecondCounter() + (uint32) jmax(0, delayMs); }
+
+private:
+    friend class JobScheduler;
+
+    String jobName;
+    JobPriority priority = JobPriority::Background;
+    uint64 sequence = 0;
+    uint32 notBefore = 0;
+    uint32 restartTime = 0;
+    bool isActive = false;
+    std::atomic<bool> shouldStop { false };
+
+    JUCE_DECLARE_NON_COPYABLE(SchedulerJob)
+};
+
+//==============================================================================
+/** Thread pool that always runs the most urgent queued job next.
+
+    Jobs are never interrupted, a running job keeps its thread until it returns,
+    but whenever a thread frees up it takes the highest priority job waiting, so
+    an edit queued during a cold build goes ahead of every background unit.
+    Jobs of the same priority run in the order they were added.
+
+    A job can be given a start time, until then it stays in the queue without
+    taking a thread and isn't listed among the jobs.
+
+    Idle jobs never take the last thread, something more urgent arriving always
+    finds one free. A pool asked for a single thread gets a second one for that.
+*/
+class JobScheduler
+{
+public:
+    explicit JobScheduler(int numberOfThreads);
+    ~JobScheduler();
+
+    /** Queues a job, the scheduler takes ownership and deletes it once finished.
+        The job isn't started before the millisecond counter reaches notBefore, if given.
+    */
+    void addJob(SchedulerJob* job, JobPriority priority, uint32 notBefore = 0);
+
+    /** Moves a job still waiting in the queue ahead, never lowers its priority. */
+    void raisePriority(SchedulerJob* job, JobPriority priority);
+
+    /** Changes when a job still waiting in the queue may start, false once it is running or gone. */
+    bool setStartTime(SchedulerJob* job, uint32 notBefore);
+
+    /** Drops the queued jobs and asks the running ones to exit, then waits for them. */
+    bool removeAllJobs(int timeOutMs);
+
+    /** Removes all jobs and stops the threads, nothing added afterwards is run. */
+    void stop(int timeOutMs);
+
+    bool containsJobNamed(const String& name) const;
+
+    /** Running jobs first, then the queued ones in the order they will run. */
+    StringArray getNamesOfAllJobs() const;
+
+private:
+    class WorkerThread;
+
+    SchedulerJob* waitForNextJob(Thread& thread);
+    void finishJob(SchedulerJob* job, SchedulerJob::JobStatus status);
+    static bool runsBefore(const SchedulerJob* first, const SchedulerJob* second);
+    static bool isDelayed(const SchedulerJob* job, uint32 now);
+
+    mutable std::mutex mutex;
+    std::condition_variable jobsCondition;
+    std::condition_variable finishedCondition;
+    std::vector<std::unique_ptr<SchedulerJob>> jobs;
+    uint64 nextSequence = 0;
+
+    OwnedArray<WorkerThread> threads;
+    int maxIdleJobs = 1;
+
+    JUCE_DECLARE_NON_COPYABLE(JobScheduler)
+};
@@ -35,755 +35,3074 @@
 #include "LiveCodeBuilder.h"
 
 //==============================================================================
-class DiagnosticReporter : public TextDiagnosticPrinter {
+/** Turns clang diagnostics into the Projucer's DiagnosticMessage form as they are
+    emitted, ranges in character offsets of the file, notes following their diagnostic.
+
+    While a compile job streams, each new diagnostic is appended to what the builder shows for
+    the unit, the first one replacing the list of the previous compile, so the first error shows
+    up as soon as clang finds it rather than at the end.
+*/
+class DiagnosticReporter : public DiagnosticConsumer
+{
 public:
-    DiagnosticReporter(LiveCodeBuilderImpl& builder, raw_ostream &os, DiagnosticOptions *diags)
-        : TextDiagnosticPrinter(os, diags)
-        , livecodeBuilder(builder)
+    DiagnosticReporter(LiveCodeBuilderImpl& builder)
+        : livecodeBuilder(builder)
     {
     }
 
+    // the type values of the Projucer's DiagnosticMessage
+    enum Type
+    {
+        error = 0,
+        warning = 1,
+        note = 2
+    };
+
+    struct Part
+    {
+        String file;
+        Range<int> range;
+        String message;
+    };
+
+    struct Entry
+    {
+        Type type;
+        Part main;
+        Array<Part> notes;
+    };
+
     void clear() override
     {
-        TextDiagnosticPrinter::clear();
+        DiagnosticConsumer::clear();
 
-        errorMap.clear();
+        entries.clear();
+        streamCancelled = nullptr;
+        streamUnitPath = String();
     }
 
-    void BeginSourceFile(const LangOptions &LangOpts, const Preprocessor *PP = nullptr) override
+    /** Hands every diagnostic of the unit to the builder as it comes until the compile is cancelled. */
+    void startStreaming(const File& unit, const std::atomic<bool>& cancelled)
     {
-        TextDiagnosticPrinter::BeginSourceFile(LangOpts, PP);
+        streamUnitPath = LiveCodeBuilderImpl::getCanonicalPath(unit);
+        streamCancelled = &cancelled;
+        hasStreamed = false;
     }
 
-    void EndSourceFile() override
+    void stopStreaming()
     {
-        TextDiagnosticPrinter::EndSourceFile();
+        streamCancelled = nullptr;
     }
 
-    void finish() override
+    void BeginSourceFile(const LangOptions& LangOpts, const Preprocessor* PP = nullptr) override
     {
-        TextDiagnosticPrinter::finish();
+        langOpts = &LangOpts;
     }
 
-    bool IncludeInDiagnosticCounts() const override
+    void EndSourceFile() override
     {
-        return TextDiagnosticPrinter::IncludeInDiagnosticCounts();
+        langOpts = nullptr;
     }
 
-    void HandleDiagnostic(DiagnosticsEngine::Level DiagLevel, const Diagnostic &Info) override
+    void HandleDiagnostic(DiagnosticsEngine::Level DiagLevel, const Diagnostic& Info) override
     {
-        TextDiagnosticPrinter::HandleDiagnostic(DiagLevel, Info);
+        DiagnosticConsumer::HandleDiagnostic(DiagLevel, Info);
+
+        Type type;
+        switch (DiagLevel)
+        {
+            case DiagnosticsEngine::Fatal:
+            case DiagnosticsEngine::Error:      type = error; break;
+            case DiagnosticsEngine::Warning:    type = warning; break;
+            case DiagnosticsEngine::Note:       type = note; break;
+            default:                            return;
+        }
+
+        // the cancellation checker reports through the same engine, that one isn't for the user
+        if (streamCancelled != nullptr && streamCancelled->load())
+            return;
+
+        if (type == note && entries.size() == 0)
+            return;
+
+        const Part part(describe(Info));
 
-        errorMap[DiagLevel].add(Info);
+        if (type == note)
+            entries.getReference(entries.size() - 1).notes.add(part);
+        else
+            entries.add({ type, part, Array<Part>() });
+
+        // only the new entry goes over, the list is sent on the next diagnostic update
+        if (streamCancelled != nullptr)
+        {
+            livecodeBuilder.appendDiagnostic(streamUnitPath, toValueTree(part, type), type == note, ! hasStreamed);
+            hasStreamed = true;
+        }
     }
 
-    HashMap<DiagnosticsEngine::Level, Array<Diagnostic>>& getErrorMap()
+    ValueTree getDiagnosticList() const
     {
-        return errorMap;
-    }
+        ValueTree list(MessageTypes::DIAGNOSTIC_LIST);
 
-protected:
-    LiveCodeBuilderImpl& livecodeBuilder;
-    HashMap<DiagnosticsEngine::Level, Array<Diagnostic>> errorMap;
-};
+        for (auto& entry : entries)
+        {
+            ValueTree v(toValueTree(entry.main, entry.type));
 
-//==============================================================================
-class CompileJob : public ThreadPoolJob
-{
-public:
-    CompileJob(LiveCodeBuilderImpl& liveCodeBuilder_,
-               const File& file,
-               const String& string,
-               bool useString,
-               const Array<LiveCodeChange>& changes,
-               bool useChanges)
-        : ThreadPoolJob(file.getFileName()),
-          livecodeBuilder(liveCodeBuilder_),
-          fileToCompile(file),
-          stringToCompile(string),
-          isUsingString(useString),
-          changesToCompile(changes),
-          isUsingChanges(useChanges)
-    {
+            // the Projucer shows the first child as the associated diagnostic
+            for (auto& part : entry.notes)
+                v.addChild(toValueTree(part, note), -1, nullptr);
+
+            list.addChild(v, -1, nullptr);
+        }
+
+        return list;
     }
 
-    JobStatus runJob() override
+private:
+    Part describe(const Diagnostic& info) const
     {
-        String errorString;
+        Part part;
 
-        CompilationStatus status = livecodeBuilder.compileFileIfNeeded(fileToCompile,
-                                                                       stringToCompile,
-                                                                       isUsingString,
-                                                                       changesToCompile,
-                                                                       isUsingChanges,
-                                                                       errorString);
+        SmallString<256> message;
+        info.FormatDiagnostic(message);
+        part.message = String::fromUTF8(message.data(), (int) message.size());
+
+        if (! info.hasSourceManager() || info.getLocation().isInvalid())
+            return part;
+
+        const SourceManager& sourceManager = info.getSourceManager();
+        const SourceLocation start(sourceManager.getFileLoc(info.getLocation()));
+
+        const StringRef fileName(sourceManager.getFilename(start));
+        part.file = String::fromUTF8(fileName.data(), (int) fileName.size());
+        part.range = Range<int>::emptyRange(getCharacterOffset(sourceManager, start));
 
-        if (status == CompilationStatus::Error)
+        // the first highlighted range gives the extent when it ends in the same file
+        if (info.getNumRanges() > 0)
         {
-            LOG(errorString);
+            const CharSourceRange& highlighted = info.getRange(0);
+            SourceLocation end(sourceManager.getFileLoc(highlighted.getEnd()));
 
-            ValueTree l(MessageTypes::DIAGNOSTIC_LIST);
+            if (highlighted.isTokenRange() && langOpts != nullptr)
+                end = end.getLocWithOffset((int) Lexer::MeasureTokenLength(end, sourceManager, *langOpts));
 
-            auto diagnostics = livecodeBuilder.getDiagnostics();
-            auto& errorMap = diagnostics->getErrorMap();
-            for (auto& info : errorMap[DiagnosticsEngine::Error])
+            if (sourceManager.getFileID(end) == sourceManager.getFileID(start))
             {
-                (void)info;
-                //auto range = info.getRange(0);
-
-                ValueTree v (MessageTypes::DIAGNOSTIC);
-                v.setProperty (Ids::text, errorString, nullptr);
-                v.setProperty (Ids::file, fileToCompile.getFullPathName(), nullptr);
-                //v.setProperty (Ids::range, fileToCompile.getFullPathName() + ":" + String(beg) + ":" + String(end));
-                //v.setProperty (Ids::type, (int) type);
-                //if (associatedDiagnostic != nullptr)
-                //    v.addChild (associatedDiagnostic->toValueTree(), 0);
-                l.addChild(v, -1, nullptr);
+                const int endOffset = getCharacterOffset(sourceManager, end);
+                if (endOffset > part.range.getStart())
+                    part.range = part.range.withEnd(endOffset);
             }
-
-            livecodeBuilder.sendMessage(ValueTree(MessageTypes::BUILD_FAILED));
-            livecodeBuilder.sendMessage(l);
-        }
-        else if (status == CompilationStatus::NotNeeded)
-        {
         }
 
-        livecodeBuilder.sendActivityListUpdate();
+        return part;
+    }
+
+    static int getCharacterOffset(const SourceManager& sourceManager, SourceLocation location)
+    {
+        const std::pair<FileID, unsigned> decomposed(sourceManager.getDecomposedLoc(location));
+
+        bool invalid = false;
+        const StringRef buffer(sourceManager.getBufferData(decomposed.first, &invalid));
+        if (invalid || decomposed.second > buffer.size())
+            return (int) decomposed.second;
 
-        return ThreadPoolJob::jobHasFinished;
+        return (int) CharPointer_UTF8(buffer.data()).lengthUpTo(CharPointer_UTF8(buffer.data() + decomposed.second));
+    }
+
+    static ValueTree toValueTree(const Part& part, Type type)
+    {
+        ValueTree v(MessageTypes::DIAGNOSTIC);
+        v.setProperty(Ids::text, part.message, nullptr);
+        v.setProperty(Ids::file, part.file, nullptr);
+        v.setProperty(Ids::range, part.file + ":" + String(part.range.getStart()) + ":" + String(part.range.getEnd()), nullptr);
+        v.setProperty(Ids::type, (int) type, nullptr);
+        return v;
     }
 
-private:
     LiveCodeBuilderImpl& livecodeBuilder;
-    File fileToCompile;
-    String stringToCompile;
-    bool isUsingString;
-    Array<LiveCodeChange> changesToCompile;
-    bool isUsingChanges;
+    const LangOptions* langOpts = nullptr;
+    const std::atomic<bool>* streamCancelled = nullptr;
+    String streamUnitPath;
+    bool hasStreamed = false;
+    Array<Entry> entries;
 };
 
 //==============================================================================
-class CleanAllJob : public ThreadPoolJob
+class IncludeRecorder : public PPCallbacks
 {
 public:
-    CleanAllJob(LiveCodeBuilderImpl& liveCodeBuilder_)
-        : ThreadPoolJob("__clean"),
-          livecodeBuilder(liveCodeBuilder_)
+    IncludeRecorder(SourceManager& sourceManager_, SortedSet<String>& includedFiles_)
+        : sourceManager(sourceManager_),
+          includedFiles(includedFiles_)
     {
     }
 
-    JobStatus runJob() override
+    void FileChanged(SourceLocation loc, FileChangeReason reason, SrcMgr::CharacteristicKind fileType, FileID prevFID) override
     {
-        livecodeBuilder.cleanAllFiles();
-        livecodeBuilder.sendActivityListUpdate();
+        if (reason != EnterFile)
+            return;
+
+        const FileID fileID = sourceManager.getFileID(sourceManager.getExpansionLoc(loc));
+        if (fileID == sourceManager.getMainFileID())
+            return;
 
-        return ThreadPoolJob::jobHasFinished;
+        if (const FileEntry* entry = sourceManager.getFileEntryForID(fileID))
+            includedFiles.add(LiveCodeBuilderImpl::getCanonicalPath(File(String::fromUTF8(entry->getName()))));
     }
 
 private:
-    LiveCodeBuilderImpl& livecodeBuilder;
+    SourceManager& sourceManager;
+    SortedSet<String>& includedFiles;
 };
 
 //==============================================================================
-class RunAppJob : public ThreadPoolJob
+class GeneratePrecompiledHeaderAction : public GeneratePCHAction
 {
 public:
-    RunAppJob(LiveCodeBuilderImpl& liveCodeBuilder_)
-        : ThreadPoolJob("__run"),
-          livecodeBuilder(liveCodeBuilder_)
+    GeneratePrecompiledHeaderAction(SortedSet<String>& includedFiles_)
+        : includedFiles(includedFiles_)
     {
     }
 
-    JobStatus runJob() override
+protected:
+    bool BeginSourceFileAction(CompilerInstance& compilerInstance, StringRef fileName) override
     {
-        livecodeBuilder.runApp();
-        livecodeBuilder.sendActivityListUpdate();
+        Preprocessor& preprocessor = compilerInstance.getPreprocessor();
+        preprocessor.addPPCallbacks(llvm::make_unique<IncludeRecorder>(preprocessor.getSourceManager(), includedFiles));
 
-        return ThreadPoolJob::jobHasFinished;
+        return GeneratePCHAction::BeginSourceFileAction(compilerInstance, fileName);
     }
 
 private:
-    LiveCodeBuilderImpl& livecodeBuilder;
+    SortedSet<String>& includedFiles;
 };
 
 //==============================================================================
-class ActivityListUpdateJob : public ThreadPoolJob
+/** Sits in front of the code generator and stops the parser once the compile has been cancelled.
+
+    Returning false from HandleTopLevelDecl makes ParseAST bail out, and the fatal error
+    reported keeps the code generator from emitting the deferred declarations.
+*/
+class CancellationChecker : public ASTConsumer
 {
 public:
-    ActivityListUpdateJob(LiveCodeBuilderImpl& liveCodeBuilder_)
-        : ThreadPoolJob("__activity"),
-        livecodeBuilder(liveCodeBuilder_)
+    CancellationChecker(DiagnosticsEngine& diagnostics_, const std::atomic<bool>& cancelled_)
+        : diagnostics(diagnostics_),
+          cancelled(cancelled_)
     {
     }
 
-    JobStatus runJob() override
+    bool HandleTopLevelDecl(DeclGroupRef) override
     {
-        livecodeBuilder.sendActivityListUpdate();
-        return ThreadPoolJob::jobHasFinished;
+        return ! checkCancelled();
+    }
+
+    void HandleTranslationUnit(ASTContext&) override
+    {
+        checkCancelled();
     }
 
 private:
-    LiveCodeBuilderImpl& livecodeBuilder;
+    bool checkCancelled()
+    {
+        if (! cancelled.load())
+            return false;
+
+        if (! hasReported)
+        {
+            diagnostics.Report(diagnostics.getCustomDiagID(DiagnosticsEngine::Fatal, "compilation cancelled"));
+            hasReported = true;
+        }
+
+        return true;
+    }
+
+    DiagnosticsEngine& diagnostics;
+    const std::atomic<bool>& cancelled;
+    bool hasReported = false;
 };
 
 //==============================================================================
-LiveCodeBuilderImpl::LiveCodeBuilderImpl(SendMessageFunction sendFunction,
-                                         void* userInfo,
-                                         const String& projectID,
-                                         const String& cacheFolderPath)
-    : Thread("LiveCodeBuilder"),
-      sendMessageFunction(sendFunction),
-      callbackUserInfo(userInfo),
-      juceProjectID(projectID),
-      juceCacheFolder(cacheFolderPath),
-      activitiesPool(1),
-      diagOpts(new DiagnosticOptions()),
-      diagClient(new DiagnosticReporter(*this, llvm::errs(), &*diagOpts)),
-      diagIdentifier(new DiagnosticIDs()),
-      diagEngine(diagIdentifier, &*diagOpts, diagClient)
+class LiveCodeGenAction : public EmitLLVMOnlyAction
 {
-    // Initialize native targets
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmPrinter();
-    llvm::InitializeNativeTargetAsmParser();
+public:
+    LiveCodeGenAction(llvm::LLVMContext* context, const std::atomic<bool>& cancelled_, SortedSet<String>& includedFiles_)
+        : EmitLLVMOnlyAction(context),
+          cancelled(cancelled_),
+          includedFiles(includedFiles_)
+    {
+    }
 
-    // Set triple to ELF (windows)
-    llvm::Triple tripleValue(llvm::sys::getProcessTriple());
-    if (tripleValue.isOSBinFormatCOFF())
-        tripleValue.setObjectFormat(llvm::Triple::ELF);
+protected:
+    bool BeginSourceFileAction(CompilerInstance& compilerInstance, StringRef fileName) override
+    {
+        Preprocessor& preprocessor = compilerInstance.getPreprocessor();
+        preprocessor.addPPCallbacks(llvm::make_unique<IncludeRecorder>(preprocessor.getSourceManager(), includedFiles));
 
-    // Create the llvm context
-    context = llvm::make_unique<llvm::LLVMContext>();
+        return EmitLLVMOnlyAction::BeginSourceFileAction(compilerInstance, fileName);
+    }
 
-    // Create the compiler driver
-    compilerDriver = llvm::make_unique<Driver>(getExecutablePath("app"), tripleValue.str(), diagEngine);
-    compilerDriver->setTitle("clang interpreter");
-    compilerDriver->setCheckInputsExist(false);
+    std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance& compilerInstance, StringRef fileName) override
+    {
+        std::unique_ptr<ASTConsumer> codeGenerator(EmitLLVMOnlyAction::CreateASTConsumer(compilerInstance, fileName));
+        if (! codeGenerator)
+            return codeGenerator;
 
-    // Create the compiler instance
-    compilerInstance = llvm::make_unique<CompilerInstance>();
-    compilerInstance->createDiagnostics();
-    if (! compilerInstance->hasDiagnostics())
-        llvm::errs() << "Cannot create compiler diagnostics" << "\n";
+        std::vector<std::unique_ptr<ASTConsumer>> consumers;
+        consumers.push_back(llvm::make_unique<CancellationChecker>(compilerInstance.getDiagnostics(), cancelled));
+        consumers.push_back(std::move(codeGenerator));
 
-    // Cache folder
-    if (! juceCacheFolder.exists())
-        juceCacheFolder.createDirectory();
+        return llvm::make_unique<MultiplexConsumer>(std::move(consumers));
+    }
 
-    // Search for xcode installation
-    File clangPath("/Applications/Xcode.app/Contents/Developer/Toolchains/XcodeDefault.xctoolchain/usr/lib/clang");
-    if (clangPath.exists() && clangPath.isDirectory())
+private:
+    const std::atomic<bool>& cancelled;
+    SortedSet<String>& includedFiles;
+};
+
+//==============================================================================
+/** Notices the main file being entered a second time, which is what a precompiled preamble
+    loaded as a plain pch does: it brings in the unit it was built from as an implicit include.
+*/
+class MainFileReentryDetector : public PPCallbacks
+{
+public:
+    MainFileReentryDetector(SourceManager& sourceManager_, bool& reentered_)
+        : sourceManager(sourceManager_),
+          reentered(reentered_)
     {
-        DirectoryIterator iter(clangPath, false, "*", File::findDirectories);
-        while (iter.next())
-        {
-            const File includeFolder = iter.getFile().getChildFile("include");
-            if (includeFolder.exists())
-            {
-                clangIncludePath = "-I" + includeFolder.getFullPathName();
-            }
-        }
     }
 
-    // Start message pump thread
-    startThread();
-}
+    void FileChanged(SourceLocation loc, FileChangeReason reason, SrcMgr::CharacteristicKind fileType, FileID prevFID) override
+    {
+        if (reason != EnterFile)
+            return;
 
-LiveCodeBuilderImpl::~LiveCodeBuilderImpl()
-{
-    activitiesPool.removeAllJobs(true, 5000);
+        const FileID fileID = sourceManager.getFileID(sourceManager.getExpansionLoc(loc));
+        if (fileID == sourceManager.getMainFileID())
+            return;
 
-    messageQueue.push(MessageEvents::ExitThread);
-    stopThread(10000);
-}
+        const FileEntry* entry = sourceManager.getFileEntryForID(fileID);
+        if (entry != nullptr && entry == sourceManager.getFileEntryForID(sourceManager.getMainFileID()))
+            reentered = true;
+    }
+
+private:
+    SourceManager& sourceManager;
+    bool& reentered;
+};
 
 //==============================================================================
-void LiveCodeBuilderImpl::setBuildInfo(const ValueTree& data)
+/** Parses for diagnostics only, the cancellation checker is all the consumer it needs */
+class LiveSyntaxCheckAction : public SyntaxOnlyAction
 {
-    //LOG(">>>>>>>>>>>>>>>>>>>>> building project");
-    //LOG(data.toXmlString());
+public:
+    LiveSyntaxCheckAction(const std::atomic<bool>& cancelled_)
+        : cancelled(cancelled_)
+    {
+    }
 
-    // parse data
-    systemPath = data.getProperty("systempath").toString().trim();
-    userPath = data.getProperty("userpath").toString().trim();
+    /** True when clang skipped the start of the unit and took its state from the precompiled preamble */
+    bool hasUsedPreamble() const
+    {
+        return usedPreamble;
+    }
 
-    defines.clear();
-    defines.addTokens(data.getProperty("defines").toString().trim(), " ", "");
+protected:
+    bool BeginSourceFileAction(CompilerInstance& compilerInstance, StringRef fileName) override
+    {
+        Preprocessor& preprocessor = compilerInstance.getPreprocessor();
+        preprocessor.addPPCallbacks(llvm::make_unique<MainFileReentryDetector>(preprocessor.getSourceManager(), mainFileReentered));
 
-    extraCompilerFlags.clear();
-    extraCompilerFlags.addTokens(data.getProperty("extraCompilerFlags").toString().trim(), " ", "");
+        return SyntaxOnlyAction::BeginSourceFileAction(compilerInstance, fileName);
+    }
 
-    extraDLLs = data.getProperty("extraDLLs").toString().trim();
-    juceModulesFolder = data.getProperty("juceModulesFolder").toString().trim();
-    utilsCppInclude = data.getProperty("utilsCppInclude").toString().trim();
+    std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance& compilerInstance, StringRef) override
+    {
+        return llvm::make_unique<CancellationChecker>(compilerInstance.getDiagnostics(), cancelled);
+    }
 
-    // prepare files
-    compileUnits.clear();
-    userFiles.clear();
-    for (int i = 0; i < data.getNumChildren(); i++)
+    void EndSourceFileAction() override
     {
-        ValueTree child = data.getChild(i);
-        if (child.getType() == MessageTypes::COMPILEUNIT)
-        {
-            File file(child.getProperty("file"));
-            if (file.existsAsFile())
-                compileUnits.addIfNotAlreadyThere(file);
-        }
-        else if (child.getType() == MessageTypes::USERFILE)
-        {
-            File file(child.getProperty("file"));
-            if (file.existsAsFile())
-                userFiles.addIfNotAlreadyThere(file);
-        }
+        // the reader only marks the preamble file id when it loaded the pch as a preamble of this unit
+        const SourceManager& sourceManager = getCompilerInstance().getSourceManager();
+        usedPreamble = sourceManager.getPreambleFileID().isValid() && ! mainFileReentered;
+
+        SyntaxOnlyAction::EndSourceFileAction();
     }
 
-    // trigger a build project
-    sendCompileProject();
-}
+private:
+    const std::atomic<bool>& cancelled;
+    bool mainFileReentered = false;
+    bool usedPreamble = false;
+};
 
 //==============================================================================
-void LiveCodeBuilderImpl::fileUpdated(const File& file, const String& optionalText)
+class CompileJob : public SchedulerJob
 {
-    for (int i = 0; i < activitiesPool.getNumJobs(); i++)
+public:
+    CompileJob(LiveCodeBuilderImpl& liveCodeBuilder_, const File& file)
+        : SchedulerJob(file.getFileName()),
+          livecodeBuilder(liveCodeBuilder_),
+          fileToCompile(file)
+    {
+    }
+
+    /** Asks the compile in flight to stop at the next declaration, called when its input went stale */
+    void cancel()
+    {
+        cancelled = true;
+    }
+
+    /** Stops an optimisation in flight so more urgent work gets its thread, it is queued again for later */
+    void preempt()
+    {
+        preempted = true;
+        cancelled = true;
+    }
+
+    JobStatus runJob() override
     {
-        if (ThreadPoolJob* job = activitiesPool.getJob(i))
+        OptimisationTier tier = OptimisationTier::Fast;
+        CompilationStatus status = CompilationStatus::NotNeeded;
+
+        for (;;)
         {
-            if (job->getJobName() == file.getFileName())
+            // let a burst of edits settle, every new edit pushes the start further away,
+            // the job waits for it in the queue and gives its thread back meanwhile
+            const int delay = livecodeBuilder.getScheduledCompileDelay(fileToCompile, tier);
+            if (delay > 0)
             {
-                sendActivityListUpdate();
-                return;
+                if (shouldExit())
+                {
+                    livecodeBuilder.finishScheduledCompile(fileToCompile, true);
+                    return SchedulerJob::jobHasFinished;
+                }
+
+                runAgainAfter(delay);
+                return SchedulerJob::jobNeedsRunningAgain;
+            }
+
+            // a request to exit arriving after this still cancels the compile through exitRequested
+            cancelled = false;
+            if (shouldExit())
+            {
+                livecodeBuilder.finishScheduledCompile(fileToCompile, true);
+                return SchedulerJob::jobHasFinished;
+            }
+
+            status = compile(tier);
+
+            if (preempted.exchange(false) && status == CompilationStatus::Cancelled)
+            {
+                runAgainAfter(livecodeBuilder.postponeScheduledCompile(fileToCompile));
+                livecodeBuilder.sendActivityListUpdate();
+                return SchedulerJob::jobNeedsRunningAgain;
             }
+
+            // edits that arrived while compiling get compiled by this same job
+            if (! livecodeBuilder.finishScheduledCompile(fileToCompile))
+                break;
         }
-    }
 
-    activitiesPool.addJob(new CompileJob(*this,
-                                         file,
-                                         optionalText,
-                                         true,
-                                         Array<LiveCodeChange>(),
-                                         false), true);
+        // what was just compiled fast gets optimised once nothing more urgent is waiting
+        if (tier == OptimisationTier::Fast && (status == CompilationStatus::Ok || status == CompilationStatus::NotNeeded))
+            livecodeBuilder.scheduleOptimisation(fileToCompile);
 
-    sendActivityListUpdate();
-}
+        livecodeBuilder.sendActivityListUpdate();
 
-//==============================================================================
-void LiveCodeBuilderImpl::fileChanged(const File& file, const Array<LiveCodeChange>& changes)
-{
-    for (int i = 0; i < activitiesPool.getNumJobs(); i++)
+        return SchedulerJob::jobHasFinished;
+    }
+
+protected:
+    void exitRequested() override
+    {
+        cancelled = true;
+    }
+
+private:
+    CompilationStatus compile(OptimisationTier tier)
     {
-        if (ThreadPoolJob* job = activitiesPool.getJob(i))
+        String errorString;
+
+        // a BUILDINFO arriving meanwhile doesn't change the flags this compile goes with
+        const BuildSettings::Ptr settings(livecodeBuilder.getBuildSettings());
+
+        CompileWorker* worker = livecodeBuilder.acquireWorker();
+        worker->diagClient->clear();
+
+        // what optimising finds was already shown by the fast compile of the same text
+        if (tier == OptimisationTier::Fast)
+            worker->diagClient->startStreaming(fileToCompile, cancelled);
+
+        CompilationStatus status = livecodeBuilder.compileFileIfNeeded(*worker,
+                                                                       *settings,
+                                                                       fileToCompile,
+                                                                       tier,
+                                                                       cancelled,
+                                                                       errorString);
+
+        worker->diagClient->stopStreaming();
+
+        // a cancelled compile is superseded by the next one, its diagnostics are meaningless
+        if (status == CompilationStatus::Cancelled)
+        {
+            LOG("Cancelled " << fileToCompile.getFullPathName());
+        }
+        else if (status == CompilationStatus::Error && tier == OptimisationTier::Optimised)
+        {
+            // the fast module stays in place, the user already saw what this file compiles to
+            LOG("Unable to optimise " << fileToCompile.getFullPathName() << ": " << errorString);
+        }
+        else if (status == CompilationStatus::Error)
         {
-            if (job->getJobName() == file.getFileName())
+            LOG(errorString);
+
+            // the diagnostics were handed over while compiling, this is the complete list once more,
+            // or the only one when the compile failed before clang got to report anything
+            ValueTree list(worker->diagClient->getDiagnosticList());
+            if (list.getNumChildren() == 0)
             {
-                sendActivityListUpdate();
-                return;
+                ValueTree v(MessageTypes::DIAGNOSTIC);
+                v.setProperty(Ids::text, errorString, nullptr);
+                v.setProperty(Ids::file, fileToCompile.getFullPathName(), nullptr);
+                v.setProperty(Ids::type, (int) DiagnosticReporter::error, nullptr);
+                list.addChild(v, -1, nullptr);
             }
+
+            livecodeBuilder.sendMessage(ValueTree(MessageTypes::BUILD_FAILED));
+            livecodeBuilder.setDiagnostics(fileToCompile, list);
+        }
+        else if (tier == OptimisationTier::Fast)
+        {
+            // the errors of the previous text are gone, only the warnings of this one are left
+            livecodeBuilder.setDiagnostics(fileToCompile, worker->diagClient->getDiagnosticList());
         }
+
+        livecodeBuilder.releaseWorker(worker);
+
+        return status;
     }
 
-    activitiesPool.addJob(new CompileJob(*this,
-                                         file,
-                                         String(),
-                                         false,
-                                         changes,
-                                         true), true);
+    LiveCodeBuilderImpl& livecodeBuilder;
+    File fileToCompile;
+    std::atomic<bool> cancelled { false };
+    std::atomic<bool> preempted { false };
+};
+
+//==============================================================================
+class SyntaxCheckJob : public SchedulerJob
+{
+public:
+    SyntaxCheckJob(LiveCodeBuilderImpl& liveCodeBuilder_, const File& file, uint32 generation_)
+        : SchedulerJob("__check"),
+          livecodeBuilder(liveCodeBuilder_),
+          fileToCheck(file),
+          generation(generation_)
+    {
+    }
+
+    /** Called by the next change of the same file, what this one reports is already outdated */
+    void cancel()
+    {
+        cancelled = true;
+    }
+
+    JobStatus runJob() override
+    {
+        // a later change queued its own check, the text this one was meant for is gone
+        if (shouldExit() || ! livecodeBuilder.startSyntaxCheck(fileToCheck, generation, this))
+            return SchedulerJob::jobHasFinished;
+
+        const BuildSettings::Ptr settings(livecodeBuilder.getBuildSettings());
+
+        CompileWorker* worker = livecodeBuilder.acquireWorker();
+        worker->diagClient->clear();
+
+        const CompilationStatus status = livecodeBuilder.checkSyntax(*worker, *settings, fileToCheck, cancelled);
+
+        // the complete list replaces what the previous check of this unit found, even when empty
+        if (status == CompilationStatus::Ok || status == CompilationStatus::Error)
+            livecodeBuilder.setDiagnostics(fileToCheck, worker->diagClient->getDiagnosticList());
+
+        livecodeBuilder.releaseWorker(worker);
+        livecodeBuilder.finishSyntaxCheck(fileToCheck, this);
+
+        return SchedulerJob::jobHasFinished;
+    }
+
+protected:
+    void exitRequested() override
+    {
+        cancelled = true;
+    }
+
+private:
+    LiveCodeBuilderImpl& livecodeBuilder;
+    File fileToCheck;
+    uint32 generation;
+    std::atomic<bool> cancelled { false };
+};
+
+//==============================================================================
+class CleanAllJob : public SchedulerJob
+{
+public:
+    CleanAllJob(LiveCodeBuilderImpl& liveCodeBuilder_)
+        : SchedulerJob("__clean"),
+          livecodeBuilder(liveCodeBuilder_)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        livecodeBuilder.cleanAllFiles();
+        livecodeBuilder.sendActivityListUpdate();
+
+        return SchedulerJob::jobHasFinished;
+    }
+
+private:
+    LiveCodeBuilderImpl& livecodeBuilder;
+};
+
+//==============================================================================
+class RunAppJob : public SchedulerJob
+{
+public:
+    RunAppJob(LiveCodeBuilderImpl& liveCodeBuilder_)
+        : SchedulerJob("__run"),
+          livecodeBuilder(liveCodeBuilder_)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        livecodeBuilder.runApp();
+        livecodeBuilder.sendActivityListUpdate();
+
+        return SchedulerJob::jobHasFinished;
+    }
+
+private:
+    LiveCodeBuilderImpl& livecodeBuilder;
+};
+
+//==============================================================================
+class PrecompiledHeaderJob : public SchedulerJob
+{
+public:
+    PrecompiledHeaderJob(LiveCodeBuilderImpl& liveCodeBuilder_)
+        : SchedulerJob("__pch"),
+          livecodeBuilder(liveCodeBuilder_)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        const BuildSettings::Ptr settings(livecodeBuilder.getBuildSettings());
+
+        CompileWorker* worker = livecodeBuilder.acquireWorker();
+        worker->diagClient->clear();
+
+        livecodeBuilder.buildPrecompiledHeader(*worker, *settings);
+
+        livecodeBuilder.releaseWorker(worker);
+        livecodeBuilder.sendActivityListUpdate();
+
+        return SchedulerJob::jobHasFinished;
+    }
+
+private:
+    LiveCodeBuilderImpl& livecodeBuilder;
+};
+
+//==============================================================================
+class SaveIndexJob : public SchedulerJob
+{
+public:
+    SaveIndexJob(LiveCodeBuilderImpl& liveCodeBuilder_)
+        : SchedulerJob("__save"),
+          livecodeBuilder(liveCodeBuilder_)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        livecodeBuilder.saveIndex();
+
+        return SchedulerJob::jobHasFinished;
+    }
+
+private:
+    LiveCodeBuilderImpl& livecodeBuilder;
+};
+
+//==============================================================================
+class ObjectCacheJob : public SchedulerJob
+{
+public:
+    ObjectCacheJob(LiveCodeBuilderImpl& liveCodeBuilder_, const String& key)
+        : SchedulerJob("__object"),
+          livecodeBuilder(liveCodeBuilder_),
+          moduleKey(key)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        if (! shouldExit())
+            livecodeBuilder.cacheObject(moduleKey);
+
+        return SchedulerJob::jobHasFinished;
+    }
+
+private:
+    LiveCodeBuilderImpl& livecodeBuilder;
+    String moduleKey;
+};
+
+//==============================================================================
+class PrefetchModuleJob : public SchedulerJob
+{
+public:
+    PrefetchModuleJob(LiveCodeBuilderImpl& liveCodeBuilder_, const File& file, const String& key, OptimisationTier tier)
+        : SchedulerJob("__prefetch"),
+          livecodeBuilder(liveCodeBuilder_),
+          fileToLoad(file),
+          moduleKey(key),
+          moduleTier(tier)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        if (! shouldExit())
+            livecodeBuilder.prefetchModule(fileToLoad, moduleKey, moduleTier);
+
+        return SchedulerJob::jobHasFinished;
+    }
+
+private:
+    LiveCodeBuilderImpl& livecodeBuilder;
+    File fileToLoad;
+    String moduleKey;
+    OptimisationTier moduleTier;
+};
+
+//==============================================================================
+class ActivityListUpdateJob : public SchedulerJob
+{
+public:
+    ActivityListUpdateJob(LiveCodeBuilderImpl& liveCodeBuilder_)
+        : SchedulerJob("__activity"),
+        livecodeBuilder(liveCodeBuilder_)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        livecodeBuilder.sendActivityListUpdate();
+        return SchedulerJob::jobHasFinished;
+    }
+
+private:
+    LiveCodeBuilderImpl& livecodeBuilder;
+};
+
+//==============================================================================
+CompileWorker::CompileWorker(LiveCodeBuilderImpl& builder, const std::string& targetTriple)
+    : diagOpts(new DiagnosticOptions()),
+      diagClient(new DiagnosticReporter(builder)),
+      diagIdentifier(new DiagnosticIDs()),
+      diagEngine(llvm::make_unique<DiagnosticsEngine>(diagIdentifier, &*diagOpts, diagClient))
+{
+    // Create the llvm context
+    context = llvm::make_unique<llvm::LLVMContext>();
+
+    // Create the compiler driver
+    compilerDriver = llvm::make_unique<Driver>(getExecutablePath("app"), targetTriple, *diagEngine);
+    compilerDriver->setTitle("clang interpreter");
+    compilerDriver->setCheckInputsExist(false);
+
+    // Create the compiler instance, reporting to the same diagnostic client as the driver
+    compilerInstance = llvm::make_unique<CompilerInstance>();
+    compilerInstance->createDiagnostics(diagClient, false);
+    if (! compilerInstance->hasDiagnostics())
+        llvm::errs() << "Cannot create compiler diagnostics" << "\n";
+}
+
+CompileWorker::~CompileWorker()
+{
+    // The compiler instance doesn't own the client, the driver diagnostics engine does
+    compilerInstance.reset();
+    compilerDriver.reset();
+    diagEngine.reset();
+}
+
+//==============================================================================
+LiveCodeBuilderImpl::LiveCodeBuilderImpl(SendMessageFunction sendFunction,
+                                         void* userInfo,
+                                         const String& projectID,
+                                         const String& cacheFolderPath)
+    : Thread("LiveCodeBuilder"),
+      sendMessageFunction(sendFunction),
+      callbackUserInfo(userInfo),
+      juceProjectID(projectID),
+      juceCacheFolder(cacheFolderPath),
+      manifest(juceCacheFolder),
+      buildSettings(new BuildSettings()),
+      activitiesPool(SystemStats::getNumCpus())
+{
+    // Initialize native targets
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    llvm::InitializeNativeTargetAsmParser();
+
+    // Set triple to ELF (windows)
+    llvm::Triple tripleValue(llvm::sys::getProcessTriple());
+    if (tripleValue.isOSBinFormatCOFF())
+        tripleValue.setObjectFormat(llvm::Triple::ELF);
+
+    targetTriple = tripleValue.str();
+
+    // Create the linking context, the compile workers are created on demand
+    context = llvm::make_unique<llvm::LLVMContext>();
+
+    // Cache folder
+    if (! juceCacheFolder.exists())
+        juceCacheFolder.createDirectory();
+
+    loadFileHashes();
+    manifest.load();
+
+    // the modules of the previous session are loaded while the Projucer is still sending the project
+    prefetchModules();
+
+    // Search for xcode installation
+    File clangPath("/Applications/Xcode.app/Contents/Developer/Toolchains/XcodeDefault.xctoolchain/usr/lib/clang");
+    if (clangPath.exists() && clangPath.isDirectory())
+    {
+        DirectoryIterator iter(clangPath, false, "*", File::findDirectories);
+        while (iter.next())
+        {
+            const File includeFolder = iter.getFile().getChildFile("include");
+            if (includeFolder.exists())
+            {
+                clangIncludePath = "-I" + includeFolder.getFullPathName();
+            }
+        }
+    }
+
+    // Start message pump thread
+    startThread();
+}
+
+LiveCodeBuilderImpl::~LiveCodeBuilderImpl()
+{
+    // no more work comes in, then the compiles in flight are cancelled and the threads joined,
+    // before anything their jobs use is destroyed
+    messageQueue.push(MessageEvents::ExitThread);
+    stopThread(10000);
+
+    activitiesPool.stop(5000);
+
+    saveIndex();
+
+    const StringPairArray stats(getStatistics());
+    for (auto& key : stats.getAllKeys())
+        LOG(key << ": " << stats[key]);
+}
+
+StringPairArray LiveCodeBuilderImpl::getStatistics()
+{
+    StringPairArray stats;
+    stats.set("compilesStarted", String(statistics.compilesStarted.load()));
+    stats.set("compilesSucceeded", String(statistics.compilesSucceeded.load()));
+    stats.set("compilesFailed", String(statistics.compilesFailed.load()));
+    stats.set("compilesCancelled", String(statistics.compilesCancelled.load()));
+    stats.set("cacheHits", String(statistics.cacheHits.load()));
+    stats.set("syntaxChecks", String(statistics.syntaxChecks.load()));
+    stats.set("preamblesBuilt", String(statistics.preamblesBuilt.load()));
+
+    // a launch with nothing changed since the objects were cached generates no code at all
+    stats.set("objectsGenerated", String(statistics.objectsGenerated.load()));
+    stats.set("objectsLoaded", String(statistics.objectsLoaded.load()));
+    stats.set("objectsCached", String(statistics.objectsCached.load()));
+    stats.set("unitsLaunchedLazily", String(statistics.unitsLaunchedLazily.load()));
+
+    // the figure to hold against the aim of diagnostics within 100 ms of a keystroke
+    const int numSyntaxChecks = statistics.syntaxChecks.load();
+    if (numSyntaxChecks > 0)
+        stats.set("syntaxCheckAverageMs", String(statistics.syntaxCheckMilliseconds.load() / numSyntaxChecks));
+
+    int64 numInstructions = 0;
+    size_t bitcodeSize = 0;
+    {
+        std::lock_guard<std::mutex> lock(modulesMutex);
+
+        stats.set("modulesLoaded", String((int) modules.size()));
+
+        for (auto& entry : modules)
+        {
+            numInstructions += entry.second.numInstructions;
+            bitcodeSize += entry.second.bitcodeSize;
+        }
+    }
+
+    stats.set("moduleInstructions", String(numInstructions));
+    stats.set("moduleBitcodeBytes", String((int64) bitcodeSize));
+    return stats;
+}
+
+//==============================================================================
+CompileWorker* LiveCodeBuilderImpl::acquireWorker()
+{
+    std::lock_guard<std::mutex> lock(workersMutex);
+
+    if (idleWorkers.size() > 0)
+        return idleWorkers.removeAndReturn(idleWorkers.size() - 1);
+
+    workers.push_back(llvm::make_unique<CompileWorker>(*this, targetTriple));
+    return workers.back().get();
+}
+
+void LiveCodeBuilderImpl::releaseWorker(CompileWorker* worker)
+{
+    std::lock_guard<std::mutex> lock(workersMutex);
+
+    idleWorkers.add(worker);
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::setBuildInfo(const ValueTree& data)
+{
+    //LOG(">>>>>>>>>>>>>>>>>>>>> building project");
+    //LOG(data.toXmlString());
+
+    // parse data, the settings are filled in before anybody can see them
+    BuildSettings::Ptr settings(new BuildSettings());
+    settings->generation = getBuildSettings()->generation + 1;
+
+    settings->systemPath = data.getProperty("systempath").toString().trim();
+    settings->userPath = data.getProperty("userpath").toString().trim();
+
+    settings->defines.addTokens(data.getProperty("defines").toString().trim(), " ", "");
+    settings->extraCompilerFlags.addTokens(data.getProperty("extraCompilerFlags").toString().trim(), " ", "");
+
+    settings->extraDLLs = data.getProperty("extraDLLs").toString().trim();
+    settings->juceModulesFolder = data.getProperty("juceModulesFolder").toString().trim();
+    settings->utilsCppInclude = data.getProperty("utilsCppInclude").toString().trim();
+
+    // prepare files
+    for (int i = 0; i < data.getNumChildren(); i++)
+    {
+        ValueTree child = data.getChild(i);
+        if (child.getType() == MessageTypes::COMPILEUNIT)
+        {
+            File file(child.getProperty("file"));
+            if (file.existsAsFile())
+                settings->compileUnits.addIfNotAlreadyThere(file);
+        }
+        else if (child.getType() == MessageTypes::USERFILE)
+        {
+            File file(child.getProperty("file"));
+            if (file.existsAsFile())
+                settings->userFiles.addIfNotAlreadyThere(file);
+        }
+    }
+
+    // compiles in flight finish with the settings they started with
+    {
+        std::lock_guard<std::mutex> lock(buildSettingsMutex);
+        buildSettings = settings;
+    }
+
+    // precompiled header covering the juce modules and the standard library
+    File projectHeader;
+    for (int i = 0; i < settings->compileUnits.size() && projectHeader == File(); i++)
+    {
+        const File header(settings->compileUnits.getReference(i).getSiblingFile("JuceHeader.h"));
+        if (header.existsAsFile())
+            projectHeader = header;
+    }
+
+    {
+        String keySource;
+        keySource << settings->defines.joinIntoString(" ") << newLine
+                  << settings->extraCompilerFlags.joinIntoString(" ") << newLine
+                  << settings->systemPath << newLine
+                  << settings->userPath << newLine
+                  << settings->juceModulesFolder << newLine
+                  << clangIncludePath << newLine
+                  << projectHeader.getFullPathName();
+
+        // the workers read it while deciding on the precompiled header
+        std::lock_guard<std::mutex> lock(precompiledHeaderMutex);
+        juceHeaderFile = projectHeader;
+        precompiledHeaderKey = FastHash::toHexString(keySource.toRawUTF8(), keySource.getNumBytesAsUTF8());
+        precompiledHeader = File();
+        precompiledHeaderDependencies.clear();
+    }
+
+    // the flags may have changed, the driver runs again for the next compiles
+    {
+        std::lock_guard<std::mutex> lock(argumentTemplatesMutex);
+        argumentTemplates.clear();
+        argumentTemplatesGeneration = settings->generation;
+    }
+
+    // units gone from the project must not end up in the app
+    evictRemovedModules(*settings);
+
+    // trigger a build project
+    sendCompileProject();
+}
+
+BuildSettings::Ptr LiveCodeBuilderImpl::getBuildSettings()
+{
+    std::lock_guard<std::mutex> lock(buildSettingsMutex);
+    return buildSettings;
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::fileUpdated(const File& file, SourceBuffer::Ptr text)
+{
+    setDocumentText(file, text);
+    updatePrecompiledHeader(file);
+
+    if (isHeaderFile(file))
+    {
+        compileDependentsOf(file);
+        sendActivityListUpdate();
+        return;
+    }
+
+    scheduleCompile(file, editDebounceMs, JobPriority::Interactive);
+
+    sendActivityListUpdate();
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::fileChanged(const File& file, const Array<LiveCodeChange>& changes)
+{
+    if (changes.size() > 0)
+    {
+        getDocument(file)->applyChanges(changes);
+        updatePrecompiledHeader(file);
+    }
+
+    if (isHeaderFile(file))
+    {
+        compileDependentsOf(file);
+        sendActivityListUpdate();
+        return;
+    }
+
+    // diagnostics follow every keystroke, code is only generated once the typing stops
+    if (checkSyntaxWhileEditing)
+    {
+        scheduleSyntaxCheck(file);
+        scheduleCompile(file, idleCompileDelayMs, JobPriority::Interactive);
+    }
+    else
+    {
+        scheduleCompile(file, editDebounceMs, JobPriority::Interactive);
+    }
+
+    sendActivityListUpdate();
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::scheduleCompile(const File& file, int debounceMs, JobPriority priority, OptimisationTier tier)
+{
+    std::lock_guard<std::mutex> lock(scheduledCompilesMutex);
+
+    ScheduledCompile& scheduled = scheduledCompiles[getCanonicalPath(file)];
+    const uint32 startTime = Time::getMillisecondCounter() + (uint32) debounceMs;
+
+    // only another edit pushes an edit further away, the backoff of a queued optimisation doesn't
+    if (tier == OptimisationTier::Fast && scheduled.tier != OptimisationTier::Fast)
+        scheduled.startTime = startTime;
+    else
+        scheduled.startTime = jmax(scheduled.startTime, startTime);
+
+    // an edit always wins over a pending optimisation of the same file, and of the others
+    if (tier == OptimisationTier::Fast)
+    {
+        scheduled.tier = OptimisationTier::Fast;
+        postponeOptimisations();
+    }
+
+    // what the user typed, in the file or in a header it includes, is what a launch waits for
+    if (tier == OptimisationTier::Fast && (priority == JobPriority::Interactive || priority == JobPriority::Dependent))
+        scheduled.hasUserEdit = true;
+
+    // the job already queued or running for this file will pick up the latest text,
+    // a compile in flight is working on outdated input and is told to give up early
+    if (scheduled.isQueued)
+    {
+        scheduled.isStale = scheduled.isRunning;
+
+        // the priority also counts for the run of a stale or postponed job picking up this edit
+        activitiesPool.raisePriority(scheduled.job, priority);
+
+        if (scheduled.isRunning)
+            scheduled.job->cancel();
+        else
+            activitiesPool.setStartTime(scheduled.job, scheduled.startTime);
+
+        return;
+    }
+
+    // queued under the lock, so an edit coming next finds the job in the scheduler
+    scheduled.isQueued = true;
+    scheduled.job = new CompileJob(*this, file);
+    activitiesPool.addJob(scheduled.job, priority, scheduled.startTime);
+}
+
+void LiveCodeBuilderImpl::postponeOptimisations()
+{
+    const uint32 resumeTime = Time::getMillisecondCounter() + (uint32) optimisationBackoffMs;
+
+    for (auto& it : scheduledCompiles)
+    {
+        ScheduledCompile& scheduled = it.second;
+        if (! scheduled.isQueued || scheduled.tier == OptimisationTier::Fast)
+            continue;
+
+        if (scheduled.isRunning)
+        {
+            if (scheduled.runningTier == OptimisationTier::Optimised)
+                scheduled.job->preempt();
+        }
+        else
+        {
+            scheduled.startTime = jmax(scheduled.startTime, resumeTime);
+            activitiesPool.setStartTime(scheduled.job, scheduled.startTime);
+        }
+    }
+}
+
+int LiveCodeBuilderImpl::postponeScheduledCompile(const File& file)
+{
+    std::lock_guard<std::mutex> lock(scheduledCompilesMutex);
+
+    ScheduledCompile& scheduled = scheduledCompiles[getCanonicalPath(file)];
+    scheduled.isRunning = false;
+    scheduled.isStale = false;
+
+    // an edit of this file arriving meanwhile asked for its own tier
+    if (scheduled.tier != OptimisationTier::Fast)
+    {
+        scheduled.tier = scheduled.runningTier;
+        scheduled.startTime = jmax(scheduled.startTime, Time::getMillisecondCounter() + (uint32) optimisationBackoffMs);
+    }
+
+    return (int) (scheduled.startTime - Time::getMillisecondCounter());
+}
+
+int LiveCodeBuilderImpl::getScheduledCompileDelay(const File& file, OptimisationTier& tier)
+{
+    std::lock_guard<std::mutex> lock(scheduledCompilesMutex);
+
+    ScheduledCompile& scheduled = scheduledCompiles[getCanonicalPath(file)];
+
+    const int delay = (int) (scheduled.startTime - Time::getMillisecondCounter());
+    if (delay > 0)
+        return delay;
+
+    scheduled.isRunning = true;
+    scheduled.isStale = false;
+    scheduled.runningUserEdit = scheduled.hasUserEdit;
+    scheduled.hasUserEdit = false;
+
+    // requests arriving from now on say again which tier they need
+    tier = scheduled.runningTier = scheduled.tier;
+    scheduled.tier = OptimisationTier::Optimised;
+    return 0;
+}
+
+bool LiveCodeBuilderImpl::finishScheduledCompile(const File& file, bool abandoned)
+{
+    std::lock_guard<std::mutex> lock(scheduledCompilesMutex);
+
+    auto it = scheduledCompiles.find(getCanonicalPath(file));
+    if (it == scheduledCompiles.end())
+        return false;
+
+    // a launch waiting for the edits checks again, the edit that made this one stale still counts
+    pendingEditsCondition.notify_all();
+
+    if (it->second.isStale && ! abandoned)
+    {
+        it->second.isRunning = false;
+        it->second.isStale = false;
+        it->second.runningUserEdit = false;
+        return true;
+    }
+
+    scheduledCompiles.erase(it);
+    return false;
+}
+
+void LiveCodeBuilderImpl::scheduleOptimisation(const File& file)
+{
+    if (optimiseInBackground && isModuleLoaded(file) && ! isModuleOptimised(file))
+        scheduleCompile(file, 0, JobPriority::Idle, OptimisationTier::Optimised);
+}
+
+StringArray LiveCodeBuilderImpl::getFileNamesBeingOptimised()
+{
+    std::lock_guard<std::mutex> lock(scheduledCompilesMutex);
+
+    StringArray names;
+    for (auto& it : scheduledCompiles)
+    {
+        const ScheduledCompile& scheduled = it.second;
+        if ((scheduled.isRunning ? scheduled.runningTier : scheduled.tier) == OptimisationTier::Optimised)
+            names.add(File(it.first).getFileName());
+    }
+
+    return names;
+}
+
+String LiveCodeBuilderImpl::getCanonicalPath(const File& file)
+{
+    // clang names a quoted include after the folder of its includer, "../" segments and all,
+    // and File keeps them, so they are dropped here once the link is followed
+    SmallString<256> path(StringRef(file.getLinkedTarget().getFullPathName().toRawUTF8()));
+    llvm::sys::path::remove_dots(path, true);
+
+    return String::fromUTF8(path.data(), (int) path.size());
+}
+
+void LiveCodeBuilderImpl::compilePendingEditsNow()
+{
+    std::lock_guard<std::mutex> lock(scheduledCompilesMutex);
+
+    for (auto& it : scheduledCompiles)
+    {
+        ScheduledCompile& scheduled = it.second;
+        if (! scheduled.hasUserEdit)
+            continue;
+
+        scheduled.startTime = 0;
+
+        if (scheduled.isQueued && ! scheduled.isRunning)
+        {
+            activitiesPool.raisePriority(scheduled.job, JobPriority::Interactive);
+            activitiesPool.setStartTime(scheduled.job, 0);
+        }
+    }
+}
+
+bool LiveCodeBuilderImpl::hasPendingEdits()
+{
+    // the build of the rest of the project isn't waited for, only what the user changed
+    for (auto& it : scheduledCompiles)
+    {
+        const ScheduledCompile& scheduled = it.second;
+        if (scheduled.hasUserEdit || (scheduled.isRunning && scheduled.runningUserEdit))
+            return true;
+    }
+
+    return false;
+}
+
+bool LiveCodeBuilderImpl::waitForPendingEdits(int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(scheduledCompilesMutex);
+
+    return pendingEditsCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] () {
+        return ! hasPendingEdits();
+    });
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::scheduleSyntaxCheck(const File& file)
+{
+    std::lock_guard<std::mutex> lock(syntaxChecksMutex);
+
+    {
+        std::lock_guard<std::mutex> compilesLock(scheduledCompilesMutex);
+        postponeOptimisations();
+    }
+
+    ScheduledSyntaxCheck& check = syntaxChecks[getCanonicalPath(file)];
+    ++check.generation;
+
+    if (check.job != nullptr)
+        check.job->cancel();
+
+    activitiesPool.addJob(new SyntaxCheckJob(*this, file, check.generation), JobPriority::Interactive);
+}
+
+bool LiveCodeBuilderImpl::startSyntaxCheck(const File& file, uint32 generation, SyntaxCheckJob* job)
+{
+    std::lock_guard<std::mutex> lock(syntaxChecksMutex);
+
+    ScheduledSyntaxCheck& check = syntaxChecks[getCanonicalPath(file)];
+    if (check.generation != generation)
+        return false;
+
+    // a check left over from an earlier change has been cancelled already and is on its way out
+    check.job = job;
+    return true;
+}
+
+void LiveCodeBuilderImpl::finishSyntaxCheck(const File& file, SyntaxCheckJob* job)
+{
+    std::lock_guard<std::mutex> lock(syntaxChecksMutex);
+
+    auto it = syntaxChecks.find(getCanonicalPath(file));
+    if (it != syntaxChecks.end() && it->second.job == job)
+        it->second.job = nullptr;
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::fileReset(const File& file)
+{
+    // forget the edited text, the bitcode of the saved text is still in the cache
+    closeDocument(file);
+
+    {
+        std::lock_guard<std::mutex> lock(preamblesMutex);
+
+        auto it = preambles.find(getCanonicalPath(file));
+        if (it != preambles.end())
+        {
+            it->second.file.deleteFile();
+            preambles.erase(it);
+        }
+    }
+
+    sendActivityListUpdate();
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::reloadComponents()
+{
+    // TODO
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::cleanAll()
+{
+    activitiesPool.addJob(new CleanAllJob(*this), JobPriority::Interactive);
+
+    sendActivityListUpdate();
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::launchApp()
+{
+    //activitiesPool.addJob(new RunAppJob(*this), JobPriority::Interactive);
+
+    // edits only checked for syntax so far must be compiled for the app to run what the user typed
+    compilePendingEditsNow();
+
+    sendActivityListUpdate();
+
+    // woken by every compile that finishes, the app is launched as soon as the edits are in
+    if (! waitForPendingEdits(launchWaitTimeoutMs))
+        LOG("Launching before the pending edits were compiled");
+
+    runApp();
+}
+
+void LiveCodeBuilderImpl::runApp()
+{
+    const BuildSettings::Ptr settings(getBuildSettings());
+    const Array<File>& compileUnits = settings->compileUnits;
+
+    Array<File> bitcodeFiles;
+    StringArray lazyKeys;
+
+    {
+        std::lock_guard<std::mutex> lock(modulesMutex);
+        std::lock_guard<std::mutex> contextLock(contextMutex);
+
+        // every unit of the project has to be there, the registry only holds current units
+        bool allUnitsLoaded = compileUnits.size() > 0;
+        for (int i = 0; i < compileUnits.size() && allUnitsLoaded; i++)
+        {
+            auto it = modules.find(getCanonicalPath(compileUnits.getReference(i)));
+            allUnitsLoaded = it != modules.end() && it->second.isVerified;
+        }
+
+        if (! allUnitsLoaded)
+            return;
+
+        // the activity list only shows work in flight, what each unit runs at is told here
+        for (auto& entry : modules)
+            LOG_INFO(LogCategory::Build, entry.first << (entry.second.tier == OptimisationTier::Fast ? ": -O0" : ": -O2"));
+
+        if (! liveJIT)
+        {
+            liveJIT = llvm::make_unique<LiveJIT>(targetTriple);
+
+            if (precompileHotFunctions)
+                liveJIT->setHotFunctionsFile(juceCacheFolder.getChildFile("jit").getChildFile("hot-functions.txt"));
+        }
+
+        // units generated for a previous launch or found in the object cache are linked as they are,
+        // a lazy launch hands over the bitcode of the others and generates code function by function
+        StringArray linkedUnitPaths;
+        for (int i = 0; i < compileUnits.size(); i++)
+        {
+            const String unitPath(getCanonicalPath(compileUnits.getReference(i)));
+            const LoadedModule& loaded = modules[unitPath];
+
+            if (liveJIT->isUpToDate(unitPath, loaded.key))
+            {
+                linkedUnitPaths.add(unitPath);
+                continue;
+            }
+
+            // an object from the cache comes with the names of its static constructors,
+            // the module isn't needed to link it
+            const File objectFile(getCacheObjectFile(loaded.key));
+            const String objectPath(objectFile.getRelativePathFrom(juceCacheFolder));
+            if (liveJIT->loadObject(unitPath, loaded.key, objectFile))
+            {
+                LOG("Loading object for " << unitPath);
+                ++statistics.objectsLoaded;
+                manifest.updateUnit(unitPath, [&] (BuildManifest::Unit& unit) { unit.objectFile = objectPath; });
+
+                linkedUnitPaths.add(unitPath);
+                continue;
+            }
+
+            if (lazyLaunch && ! objectFile.existsAsFile())
+            {
+                const File bitcodeFile(getCacheBitCodeFile(loaded.key));
+                if (! bitcodeFile.existsAsFile())
+                {
+                    SmallString<0> bitcode;
+                    llvm::raw_svector_ostream stream(bitcode);
+                    llvm::WriteBitcodeToFile(loaded.module.get(), stream);
+
+                    bitcodeFile.getParentDirectory().createDirectory();
+                    bitcodeFile.replaceWithData(bitcode.data(), bitcode.size());
+                }
+
+                bitcodeFiles.add(bitcodeFile);
+                lazyKeys.add(loaded.key);
+                ++statistics.unitsLaunchedLazily;
+                continue;
+            }
+
+            LOG((objectFile.existsAsFile() ? "Loading object for " : "Generating code for ") << unitPath);
+
+            // the registry keeps its module for the next launch, the JIT gets a copy, for a module
+            // still mapped from the cache that's a fresh one, so the registry never holds bodies
+            ModulePtr module(loaded.module->getMaterializer() != nullptr ? readLazyModule(mapBitcodeFile(getCacheBitCodeFile(loaded.key)))
+                                                                         : llvm::CloneModule(loaded.module.get()));
+            if (! module || module->materializeAll())
+            {
+                LOG("Unable to load bitcode for " << unitPath);
+                return;
+            }
+
+            if (! liveJIT->compileModule(unitPath, loaded.key, *module, objectFile))
+            {
+                LOG("Unable to generate code for " << unitPath);
+                return;
+            }
+
+            ++statistics.objectsGenerated;
+
+            manifest.updateUnit(unitPath, [&] (BuildManifest::Unit& unit) { unit.objectFile = objectPath; });
+
+            linkedUnitPaths.add(unitPath);
+        }
+
+        liveJIT->retainUnits(linkedUnitPaths);
+    }
+
+    // what runs lazily now is generated in the background, the next launch links the objects
+    // and does no code generation for the units that didn't change
+    for (auto& key : lazyKeys)
+        activitiesPool.addJob(new ObjectCacheJob(*this, key), JobPriority::Idle);
+
+    // the app runs in this process, a crash in it must not take the index of the session along
+    saveIndex();
+
+    sendMessage(ValueTree(MessageTypes::LAUNCHED));
+
+    // the module locks are released, edits keep compiling while the app runs
+    std::vector<std::string> args;
+    args.push_back("app");
+
+    String errorString;
+    const int result = liveJIT->runMain(bitcodeFiles, args, errorString);
+    if (errorString.isNotEmpty())
+    {
+        llvm::errs() << errorString.toRawUTF8() << "\n";
+
+        LOG(errorString);
+        return;
+    }
+
+    if (result != 0)
+        llvm::errs() << "Error executing main.\n";
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::pong()
+{
+    sendMessage(ValueTree(MessageTypes::PING));
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::foregroundProcess(bool parentActive)
+{
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::sendCompileProject()
+{
+    messageQueue.push(MessageEvents::CompileProject);
+}
+
+void LiveCodeBuilderImpl::sendActivityListUpdate()
+{
+    // a burst of requests collapses into the one update still waiting to be sent
+    if (! activityListPending.exchange(true))
+        messageQueue.push(MessageEvents::UpdateActivities);
+}
+
+void LiveCodeBuilderImpl::sendDiagnosticListUpdate()
+{
+    if (! diagnosticListPending.exchange(true))
+        messageQueue.push(MessageEvents::UpdateDiagnostics);
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::run()
+{
+    std::vector<MessageEvents> events;
+
+    while (! threadShouldExit())
+    {
+        // everything posted since the last round is handled as one batch
+        events.clear();
+        messageQueue.waitAndDrainInto(events);
+
+        for (MessageEvents event : events)
+        {
+            if (threadShouldExit())
+                break;
+
+            switch (event)
+            {
+                case MessageEvents::CompileProject:
+                {
+                    sendActivityListUpdate();
+                    buildProjectIfNeeded();
+                    break;
+                }
+
+                case MessageEvents::UpdateActivities:
+                {
+                    updateActivityList();
+                    break;
+                }
+
+                case MessageEvents::UpdateDiagnostics:
+                {
+                    updateDiagnosticList();
+                    break;
+                }
+
+                default:
+                {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void LiveCodeBuilderImpl::updateActivityList()
+{
+    // everything that changes while waiting for the next frame goes out with this update
+    const int remaining = (int) (lastActivityListTime + (uint32) activityListIntervalMs - Time::getMillisecondCounter());
+    if (hasSentActivityList && remaining > 0 && remaining <= activityListIntervalMs)
+        wait(remaining);
+
+    activityListPending = false;
+
+    StringArray list = activitiesPool.getNamesOfAllJobs();
+    const StringArray optimising(getFileNamesBeingOptimised());
+    StringArray finalList;
+    for (int i = 0; i < list.size(); i++)
+    {
+        String& job = list.getReference(i);
+        if (job.endsWithIgnoreCase(".cpp") || job.endsWithIgnoreCase(".c") || job.endsWithIgnoreCase(".mm"))
+            finalList.add((optimising.contains(job) ? "Optimise " : "Compile ") + job);
+        else if (! job.startsWith("__"))
+            finalList.add(job);
+    }
+
+    lastActivityListTime = Time::getMillisecondCounter();
+
+    if (hasSentActivityList && finalList == lastActivityList)
+        return;
+
+    lastActivityList.swapWith(finalList);
+    hasSentActivityList = true;
+
+    ValueTree v(MessageTypes::ACTIVITY_LIST);
+    v.setProperty(Ids::list, concatenateListOfStrings(lastActivityList), nullptr);
+    sendMessage(v);
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::setDiagnostics(const File& unit, const ValueTree& list)
+{
+    {
+        std::lock_guard<std::mutex> lock(diagnosticsMutex);
+
+        if (list.getNumChildren() > 0)
+            diagnosticsByUnit[getCanonicalPath(unit)] = list;
+        else if (diagnosticsByUnit.erase(getCanonicalPath(unit)) == 0)
+            return;
+    }
+
+    sendDiagnosticListUpdate();
+}
+
+void LiveCodeBuilderImpl::appendDiagnostic(const String& unitPath, const ValueTree& diagnostic, bool isNote, bool replacesList)
+{
+    {
+        std::lock_guard<std::mutex> lock(diagnosticsMutex);
+
+        ValueTree& list = diagnosticsByUnit[unitPath];
+        if (replacesList || ! list.isValid())
+            list = ValueTree(MessageTypes::DIAGNOSTIC_LIST);
+
+        // the Projucer shows the first child as the associated diagnostic
+        if (! isNote)
+            list.addChild(diagnostic, -1, nullptr);
+        else if (list.getNumChildren() > 0)
+            list.getChild(list.getNumChildren() - 1).addChild(diagnostic, -1, nullptr);
+    }
+
+    sendDiagnosticListUpdate();
+}
+
+void LiveCodeBuilderImpl::updateDiagnosticList()
+{
+    // a stream of diagnostics from several workers goes out as one list per frame
+    const int remaining = (int) (lastDiagnosticListTime + (uint32) activityListIntervalMs - Time::getMillisecondCounter());
+    if (remaining > 0 && remaining <= activityListIntervalMs)
+        wait(remaining);
+
+    diagnosticListPending = false;
+
+    ValueTree mergedList(MessageTypes::DIAGNOSTIC_LIST);
+    {
+        std::lock_guard<std::mutex> lock(diagnosticsMutex);
+
+        // an error in a header is reported by every unit including it, it is shown once
+        SortedSet<String> seen;
+        for (auto& unit : diagnosticsByUnit)
+        {
+            for (int i = 0; i < unit.second.getNumChildren(); i++)
+            {
+                const ValueTree diagnostic(unit.second.getChild(i));
+                const String identity(diagnostic[Ids::range].toString() + "\n" + diagnostic[Ids::text].toString());
+
+                if (seen.add(identity))
+                    mergedList.addChild(diagnostic.createCopy(), -1, nullptr);
+            }
+        }
+    }
+
+    lastDiagnosticListTime = Time::getMillisecondCounter();
+    sendMessage(mergedList);
+}
+
+//==============================================================================
+CompilationStatus LiveCodeBuilderImpl::compileFileIfNeeded(CompileWorker& worker,
+                                                           const BuildSettings& settings,
+                                                           const File& file,
+                                                           OptimisationTier tier,
+                                                           const std::atomic<bool>& cancelled,
+                                                           String& errorString)
+{
+    errorString = String();
+
+    // headers are never compiled on their own, see compileDependentsOf
+    if (isHeaderFile(file))
+        return CompilationStatus::NotNeeded;
+
+    // the latest version of the document open in the editor, files on disk are read by clang itself
+    SourceBuffer::Ptr content(getLiveText(file));
+    const bool isLive = content != nullptr;
+
+    // the precompiled header is built at -O0 and clang refuses it for optimised compiles
+    const File precompiledHeaderFile(tier == OptimisationTier::Fast && shouldUsePrecompiledHeader(file) ? getPrecompiledHeader() : File());
+
+    std::vector<std::string> arguments;
+    std::unique_ptr<CompilerInvocation> compilerInvocation(createCompilerInvocation(worker,
+                                                                                    settings,
+                                                                                    file,
+                                                                                    precompiledHeaderFile,
+                                                                                    tier,
+                                                                                    arguments));
+    if (! compilerInvocation)
+        return CompilationStatus::Error;
+
+    // editor buffers are handed to clang from memory in place of the files on disk,
+    // the views point straight into the snapshots, which stay alive until the compile is done
+    std::map<String, SourceBuffer::Ptr> remappedFiles(getLiveTexts());
+    if (isLive)
+        remappedFiles[file.getFullPathName()] = content;
+
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> remappedBuffers;
+    remapLiveTexts(compilerInvocation->getPreprocessorOpts(), remappedFiles, remappedBuffers);
+
+    // unchanged files on disk are recognised from their status without reading them
+    const String sourceHash(isLive ? content->getHash() : getFileContentHash(file));
+    if (sourceHash.isEmpty())
+        return CompilationStatus::Error;
+
+    // the headers seen by the previous compile of this unit give the key to probe the cache with
+    SortedSet<String> knownIncludes;
+    if (getKnownDependencies(file, knownIncludes))
+    {
+        const String key(getCacheKey(sourceHash, arguments, knownIncludes));
+
+        if (isModuleLoaded(file, key))
+        {
+            ++statistics.cacheHits;
+            return CompilationStatus::NotNeeded;
+        }
+
+        // a unit optimised in an earlier session comes back at -O2, prefetched or not, when the key
+        // of that tier still holds, the fast compile would only replace it with slower code
+        String optimisedKey;
+        if (tier == OptimisationTier::Fast && ! isModuleLoaded(file) && manifest.getOptimisedKey(getCanonicalPath(file), optimisedKey))
+        {
+            std::vector<std::string> optimisedArguments;
+            if (getCompilerArguments(worker, settings, file, File(), OptimisationTier::Optimised, optimisedArguments)
+                && getCacheKey(sourceHash, optimisedArguments, knownIncludes) == optimisedKey)
+            {
+                if (isModuleLoaded(file, optimisedKey)
+                    || loadCachedModule(file, sourceHash, optimisedArguments, optimisedKey, OptimisationTier::Optimised))
+                {
+                    ++statistics.cacheHits;
+                    return CompilationStatus::NotNeeded;
+                }
+            }
+        }
+
+        if (loadCachedModule(file, sourceHash, arguments, key, tier))
+        {
+            ++statistics.cacheHits;
+            return CompilationStatus::NotNeeded;
+        }
+    }
+
+    if (cancelled.load())
+    {
+        ++statistics.compilesCancelled;
+        return CompilationStatus::Cancelled;
+    }
+
+    LOG("Compiling " << file.getFullPathName());
+    ++statistics.compilesStarted;
+
+    SmallString<0> bitcode;
+    SortedSet<String> includedFiles;
+
+    // The module lives in the worker context, only its bitcode leaves this thread
+    const uint32 compileStartTime = Time::getMillisecondCounter();
+    ModulePtr compiledModule = compileFile(worker, std::move(compilerInvocation), cancelled, includedFiles);
+    const uint32 compileMilliseconds = Time::getMillisecondCounter() - compileStartTime;
+
+    // whatever was parsed before the cancellation is incomplete, neither the
+    // module nor the headers it got to are worth keeping
+    if (cancelled.load())
+    {
+        ++statistics.compilesCancelled;
+        return CompilationStatus::Cancelled;
+    }
+
+    if (compiledModule)
+    {
+        llvm::raw_svector_ostream stream(bitcode);
+        llvm::WriteBitcodeToFile(compiledModule.get(), stream);
+        compiledModule.reset();
+    }
+
+    // headers folded into the precompiled header are never entered while parsing
+    if (precompiledHeaderFile != File())
+    {
+        std::lock_guard<std::mutex> lock(precompiledHeaderMutex);
+        includedFiles.addSet(precompiledHeaderDependencies);
+    }
+
+    updateDependencies(file, includedFiles);
+
+    if (bitcode.empty())
+    {
+        ++statistics.compilesFailed;
+        return CompilationStatus::Error;
+    }
+
+    // entries are immutable, an existing one already holds the very same bitcode
+    const String key(getCacheKey(sourceHash, arguments, includedFiles));
+    const File bitcodeFile(getCacheBitCodeFile(key));
+    if (! bitcodeFile.existsAsFile())
+    {
+        bitcodeFile.getParentDirectory().createDirectory();
+        bitcodeFile.replaceWithData(bitcode.data(), bitcode.size());
+    }
+
+    if (ModulePtr module = loadModuleIntoLinkingContext(llvm::MemoryBufferRef(bitcode.str(), file.getFullPathName().toRawUTF8())))
+    {
+        module->setSourceFileName(file.getFullPathName().toRawUTF8());
+        addModule(file, key, std::move(module), bitcode.size(), tier);
+        updateManifest(file, sourceHash, arguments, key, tier, compileMilliseconds);
+
+        ++statistics.compilesSucceeded;
+        return CompilationStatus::Ok;
+    }
+
+    ++statistics.compilesFailed;
+    return CompilationStatus::Error;
+}
+
+bool LiveCodeBuilderImpl::loadCachedModule(const File& file,
+                                           const String& sourceHash,
+                                           const std::vector<std::string>& arguments,
+                                           const String& key,
+                                           OptimisationTier tier)
+{
+    const File bitcodeFile(getCacheBitCodeFile(key));
+    if (! bitcodeFile.existsAsFile())
+        return false;
+
+    ModulePtr module(loadLazyModule(bitcodeFile));
+    if (! module)
+        return false;
+
+    module->setSourceFileName(file.getFullPathName().toRawUTF8());
+    addModule(file, key, std::move(module), (size_t) bitcodeFile.getSize(), tier);
+    updateManifest(file, sourceHash, arguments, key, tier, 0);
+    return true;
+}
+
+//==============================================================================
+CompilationStatus LiveCodeBuilderImpl::checkSyntax(CompileWorker& worker, const BuildSettings& settings, const File& file, const std::atomic<bool>& cancelled)
+{
+    // only the text in the editor changes with every keystroke, anything else is left to the compile
+    SourceBuffer::Ptr content(getLiveText(file));
+    if (content == nullptr || isHeaderFile(file))
+        return CompilationStatus::NotNeeded;
+
+    std::vector<std::string> arguments;
+    std::unique_ptr<CompilerInvocation> compilerInvocation(createCompilerInvocation(worker,
+                                                                                    settings,
+                                                                                    file,
+                                                                                    File(),
+                                                                                    OptimisationTier::Fast,
+                                                                                    arguments));
+    if (! compilerInvocation)
+        return CompilationStatus::Error;
+
+    // the preamble ends at the first token that isn't part of a preprocessor directive
+    const std::pair<unsigned, bool> preambleBounds(Lexer::ComputePreamble(StringRef(content->getData(), content->getSize()),
+                                                                          *compilerInvocation->getLangOpts()));
+
+    const File preambleFile(preambleBounds.first > 0 && preamblesUsable.load()
+                                ? getPreamble(worker, settings, file, *content, preambleBounds.first, arguments)
+                                : File());
+
+    if (cancelled.load())
+        return CompilationStatus::Cancelled;
+
+    ++statistics.syntaxChecks;
+    const uint32 checkStartTime = Time::getMillisecondCounter();
+
+    // until a check has shown clang really takes its state from a preamble, what a check
+    // relying on one finds could be bogus and isn't streamed while it runs
+    const bool streamDiagnostics = preambleFile == File() || preamblesVerified.load();
+
+    bool usedPreamble = false;
+    CompilationStatus status = parseForDiagnostics(worker, file, content, std::move(compilerInvocation), preambleFile,
+                                                   preambleBounds, cancelled, streamDiagnostics, usedPreamble);
+
+    if (preambleFile != File() && status != CompilationStatus::Cancelled)
+    {
+        if (usedPreamble)
+        {
+            preamblesVerified = true;
+        }
+        else
+        {
+            LOG("The preamble of " << file.getFullPathName() << " was not used, checking without preambles from now on");
+            preamblesUsable = false;
+
+            worker.diagClient->clear();
+            compilerInvocation = createCompilerInvocation(worker, settings, file, File(), OptimisationTier::Fast, arguments);
+            if (! compilerInvocation)
+                return CompilationStatus::Error;
+
+            status = parseForDiagnostics(worker, file, content, std::move(compilerInvocation), File(),
+                                         preambleBounds, cancelled, true, usedPreamble);
+        }
+    }
+
+    const uint32 checkMilliseconds = Time::getMillisecondCounter() - checkStartTime;
+    statistics.syntaxCheckMilliseconds += (int) checkMilliseconds;
+
+    LOG_DEBUG(LogCategory::Build, "Checked " << file.getFileName() << " in " << (int) checkMilliseconds << " ms"
+                                             << (usedPreamble ? " after its preamble" : ""));
+
+    return status;
+}
+
+CompilationStatus LiveCodeBuilderImpl::parseForDiagnostics(CompileWorker& worker,
+                                                           const File& file,
+                                                           SourceBuffer::Ptr content,
+                                                           std::unique_ptr<CompilerInvocation> compilerInvocation,
+                                                           const File& preambleFile,
+                                                           std::pair<unsigned, bool> preambleBounds,
+                                                           const std::atomic<bool>& cancelled,
+                                                           bool streamDiagnostics,
+                                                           bool& usedPreamble)
+{
+    std::map<String, SourceBuffer::Ptr> remappedFiles(getLiveTexts());
+    remappedFiles[file.getFullPathName()] = content;
+
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> remappedBuffers;
+    PreprocessorOptions& preprocessorOptions = compilerInvocation->getPreprocessorOpts();
+    remapLiveTexts(preprocessorOptions, remappedFiles, remappedBuffers);
+
+    // the preprocessor skips the bytes the preamble covers and starts from its state instead,
+    // the preamble is checked against its own key so clang doesn't have to stat every header again
+    if (preambleFile != File())
+    {
+        preprocessorOptions.ImplicitPCHInclude = preambleFile.getFullPathName().toStdString();
+        preprocessorOptions.PrecompiledPreambleBytes = preambleBounds;
+        preprocessorOptions.DisablePCHValidation = true;
+    }
+
+    CompilerInstance& compilerInstance = *worker.compilerInstance;
+    compilerInstance.setInvocation(compilerInvocation.release());
+    compilerInstance.createDiagnostics(worker.diagClient, false);
+    compilerInstance.setSourceManager(nullptr);
+    compilerInstance.setFileManager(nullptr);
+
+    if (streamDiagnostics)
+        worker.diagClient->startStreaming(file, cancelled);
+
+    LiveSyntaxCheckAction action(cancelled);
+    const bool succeeded = compilerInstance.ExecuteAction(action);
+
+    worker.diagClient->stopStreaming();
+    usedPreamble = action.hasUsedPreamble();
+
+    if (cancelled.load())
+        return CompilationStatus::Cancelled;
+
+    return succeeded ? CompilationStatus::Ok : CompilationStatus::Error;
+}
+
+File LiveCodeBuilderImpl::getPreamble(CompileWorker& worker,
+                                      const BuildSettings& settings,
+                                      const File& file,
+                                      const SourceBuffer& content,
+                                      unsigned preambleSize,
+                                      const std::vector<std::string>& arguments)
+{
+    const String path(getCanonicalPath(file));
+    const String preambleHash(FastHash::toHexString(content.getData(), preambleSize));
+
+    Preamble preamble;
+    {
+        std::lock_guard<std::mutex> lock(preamblesMutex);
+
+        auto it = preambles.find(path);
+        if (it != preambles.end())
+            preamble = it->second;
+    }
+
+    // same includes, same flags and none of the headers behind them changed
+    if (preamble.hash == preambleHash
+        && preamble.file.existsAsFile()
+        && preamble.key == getCacheKey(preambleHash, arguments, preamble.dependencies))
+        return preamble.file;
+
+    const File preambleFolder(juceCacheFolder.getChildFile("preambles"));
+    preambleFolder.createDirectory();
+
+    SortedSet<String> dependencies;
+    TemporaryFile temporaryFile(preambleFolder.getChildFile(preambleHash).withFileExtension(".pch"));
+    if (! buildPreamble(worker, settings, file, content, preambleSize, temporaryFile.getFile(), dependencies))
+        return File();
+
+    // named after what it was built from, a check still reading the previous one is left alone
+    const String key(getCacheKey(preambleHash, arguments, dependencies));
+    const File preambleFile(preambleFolder.getChildFile(key).withFileExtension(".pch"));
+    if (! temporaryFile.getFile().moveFileTo(preambleFile))
+        return File();
+
+    {
+        std::lock_guard<std::mutex> lock(preamblesMutex);
+
+        Preamble& entry = preambles[path];
+        if (entry.file != File() && entry.file != preambleFile)
+            entry.file.deleteFile();
+
+        entry.hash = preambleHash;
+        entry.key = key;
+        entry.file = preambleFile;
+        entry.dependencies.swapWith(dependencies);
+    }
+
+    return preambleFile;
+}
+
+bool LiveCodeBuilderImpl::buildPreamble(CompileWorker& worker,
+                                        const BuildSettings& settings,
+                                        const File& file,
+                                        const SourceBuffer& content,
+                                        unsigned preambleSize,
+                                        const File& outputFile,
+                                        SortedSet<String>& dependencies)
+{
+    std::vector<std::string> arguments;
+    std::unique_ptr<CompilerInvocation> compilerInvocation(createCompilerInvocation(worker,
+                                                                                    settings,
+                                                                                    file,
+                                                                                    File(),
+                                                                                    OptimisationTier::Fast,
+                                                                                    arguments));
+    if (! compilerInvocation)
+        return false;
+
+    LOG_DEBUG(LogCategory::Build, "Building preamble of " << file.getFullPathName());
+    ++statistics.preamblesBuilt;
+
+    std::map<String, SourceBuffer::Ptr> remappedFiles(getLiveTexts());
+    remappedFiles.erase(file.getFullPathName());
+
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> remappedBuffers;
+    PreprocessorOptions& preprocessorOptions = compilerInvocation->getPreprocessorOpts();
+    remapLiveTexts(preprocessorOptions, remappedFiles, remappedBuffers);
+
+    // set up like ASTUnit builds the preamble for libclang: the unit itself, so relative includes and
+    // locations stay those of the unit, with everything after its includes blanked out
+    const size_t bufferSize = jmax((size_t) preambleSize + 1, content.getSize());
+    std::unique_ptr<llvm::MemoryBuffer> preambleBuffer(llvm::MemoryBuffer::getNewUninitMemBuffer(bufferSize, file.getFullPathName().toRawUTF8()));
+
+    char* bufferData = const_cast<char*>(preambleBuffer->getBufferStart());
+    memcpy(bufferData, content.getData(), preambleSize);
+    memset(bufferData + preambleSize, ' ', bufferSize - preambleSize - 1);
+    bufferData[bufferSize - 1] = '\n';
+
+    remappedBuffers.push_back(std::move(preambleBuffer));
+    preprocessorOptions.addRemappedFile(file.getFullPathName().toRawUTF8(), remappedBuffers.back().get());
+
+    // a preamble is built from scratch, it can't start from another one
+    preprocessorOptions.ImplicitPCHInclude.clear();
+    preprocessorOptions.PrecompiledPreambleBytes.first = 0;
+    preprocessorOptions.PrecompiledPreambleBytes.second = false;
+
+    FrontendOptions& frontendOptions = compilerInvocation->getFrontendOpts();
+    frontendOptions.ProgramAction = frontend::GeneratePCH;
+    frontendOptions.OutputFile = outputFile.getFullPathName().toStdString();
+
+    CompilerInstance& compilerInstance = *worker.compilerInstance;
+    compilerInstance.setInvocation(compilerInvocation.release());
+    compilerInstance.createDiagnostics(worker.diagClient, false);
+    compilerInstance.setSourceManager(nullptr);
+    compilerInstance.setFileManager(nullptr);
+
+    // a prefix translation unit, as for ASTUnit's preamble action, but one with errors in its
+    // includes isn't written: they come back from the check parsing them the slow way
+    GeneratePrecompiledHeaderAction action(dependencies);
+    const bool succeeded = compilerInstance.ExecuteAction(action) && outputFile.existsAsFile();
+    worker.diagClient->clear();
+
+    if (! succeeded)
+        LOG("Unable to build preamble of " << file.getFullPathName());
+
+    return succeeded;
+}
+
+void LiveCodeBuilderImpl::remapLiveTexts(PreprocessorOptions& preprocessorOptions,
+                                         const std::map<String, SourceBuffer::Ptr>& texts,
+                                         std::vector<std::unique_ptr<llvm::MemoryBuffer>>& buffers)
+{
+    preprocessorOptions.RetainRemappedFileBuffers = true;
+
+    for (auto& remappedFile : texts)
+    {
+        const SourceBuffer& text = *remappedFile.second;
+        buffers.push_back(llvm::MemoryBuffer::getMemBuffer(StringRef(text.getData(), text.getSize()),
+                                                           remappedFile.first.toRawUTF8()));
+
+        preprocessorOptions.addRemappedFile(remappedFile.first.toRawUTF8(), buffers.back().get());
+    }
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::buildProjectIfNeeded()
+{
+    // queued before the compile units so it is the first job picked up
+    updatePrecompiledHeader();
+
+    const BuildSettings::Ptr settings(getBuildSettings());
+    const Array<File>& compileUnits = settings->compileUnits;
+
+    int numberOfFilesToCompile = 0;
+
+    // The plan comes from the manifest alone, the units that took longest last time start
+    // first so the build doesn't end waiting on one big unit, new units count as the longest
+    // the durations are read once, the manifest isn't locked again for every comparison
+    std::vector<std::pair<uint32, File>> unitsToCompile;
+    unitsToCompile.reserve((size_t) compileUnits.size());
+    for (auto& file : compileUnits)
+        unitsToCompile.push_back(std::make_pair(getLastCompileDuration(file), file));
+
+    std::stable_sort(unitsToCompile.begin(), unitsToCompile.end(), [] (const std::pair<uint32, File>& first, const std::pair<uint32, File>& second) {
+        return first.first > second.first;
+    });
+
+    // compile units
+    for (auto& unit : unitsToCompile)
+    {
+        const File& file = unit.second;
+
+        if (! isModuleLoaded(file))
+        {
+            scheduleCompile(file, 0, JobPriority::Background);
+
+            ++numberOfFilesToCompile;
+        }
+    }
+
+    if (compileUnits.size() > 0 && numberOfFilesToCompile == 0)
+    {
+        activitiesPool.addJob(new ActivityListUpdateJob(*this), JobPriority::Interactive);
+    }
+
+    sendActivityListUpdate();
+}
+
+uint32 LiveCodeBuilderImpl::getLastCompileDuration(const File& file) const
+{
+    const uint32 compileMilliseconds = manifest.getCompileMilliseconds(getCanonicalPath(file));
+    if (compileMilliseconds == 0)
+        return std::numeric_limits<uint32>::max();
+
+    return compileMilliseconds;
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::cleanAllFiles()
+{
+    {
+        std::lock_guard<std::mutex> lock(precompiledHeaderMutex);
+        precompiledHeader = File();
+        precompiledHeaderDependencies.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(preamblesMutex);
+        preambles.clear();
+    }
+
+    {
+        // the hashes are still right, but their file goes away with the rest of the cache
+        std::lock_guard<std::mutex> lock(hashesMutex);
+        fileHashesChanged = true;
+    }
+
+    clearModules();
+    manifest.clear();
+
+    DirectoryIterator it(juceCacheFolder, false);
+    while (it.next())
+    {
+        File file = it.getFile();
+        file.deleteRecursively();
+    }
+}
+
+//==============================================================================
+LiveDocument::Ptr LiveCodeBuilderImpl::getDocument(const File& file)
+{
+    std::lock_guard<std::mutex> lock(documentsMutex);
+
+    LiveDocument::Ptr& document = documents[file.getFullPathName()];
+    if (document == nullptr)
+    {
+        MemoryBlock data;
+        file.loadFileAsData(data);
+        document = new LiveDocument(new SourceBuffer(data.getData(), data.getSize()));
+    }
+
+    return document;
+}
+
+void LiveCodeBuilderImpl::setDocumentText(const File& file, SourceBuffer::Ptr text)
+{
+    LiveDocument::Ptr document;
+    {
+        std::lock_guard<std::mutex> lock(documentsMutex);
+
+        // a document opened by this update starts with its text, the file on disk is never read
+        LiveDocument::Ptr& entry = documents[file.getFullPathName()];
+        if (entry == nullptr)
+        {
+            entry = new LiveDocument(text);
+            return;
+        }
+
+        document = entry;
+    }
+
+    document->setText(text);
+}
+
+SourceBuffer::Ptr LiveCodeBuilderImpl::getLiveText(const File& file)
+{
+    LiveDocument::Ptr document;
+    {
+        std::lock_guard<std::mutex> lock(documentsMutex);
+
+        auto it = documents.find(file.getFullPathName());
+        if (it == documents.end())
+            return nullptr;
+
+        document = it->second;
+    }
+
+    return document->getSnapshot();
+}
+
+std::map<String, SourceBuffer::Ptr> LiveCodeBuilderImpl::getLiveTexts()
+{
+    std::map<String, LiveDocument::Ptr> openDocuments;
+    {
+        std::lock_guard<std::mutex> lock(documentsMutex);
+        openDocuments = documents;
+    }
+
+    std::map<String, SourceBuffer::Ptr> texts;
+    for (auto& document : openDocuments)
+        texts[document.first] = document.second->getSnapshot();
+
+    return texts;
+}
+
+void LiveCodeBuilderImpl::closeDocument(const File& file)
+{
+    std::lock_guard<std::mutex> lock(documentsMutex);
+
+    documents.erase(file.getFullPathName());
+}
+
+//==============================================================================
+bool LiveCodeBuilderImpl::isHeaderFile(const File& file)
+{
+    return file.hasFileExtension("h;hh;hpp;hxx;inl");
+}
+
+void LiveCodeBuilderImpl::updateDependencies(const File& file, const SortedSet<String>& includedFiles, bool persist)
+{
+    // a failed compile can stop before reaching some includes, keep what we knew
+    if (includedFiles.size() == 0)
+        return;
+
+    const String unitPath(getCanonicalPath(file));
+
+    if (persist)
+    {
+        manifest.updateUnit(unitPath, [&] (BuildManifest::Unit& unit) { unit.dependencies = includedFiles; });
+        scheduleIndexSave();
+    }
+
+    std::lock_guard<std::mutex> lock(dependenciesMutex);
+
+    SortedSet<String>& previousFiles = includesByUnit[unitPath];
+    for (int i = 0; i < previousFiles.size(); i++)
+        unitsByHeader[previousFiles.getReference(i)].removeValue(unitPath);
+
+    for (int i = 0; i < includedFiles.size(); i++)
+        unitsByHeader[includedFiles.getReference(i)].add(unitPath);
+
+    previousFiles = includedFiles;
+}
+
+bool LiveCodeBuilderImpl::getKnownDependencies(const File& file, SortedSet<String>& includedFiles)
+{
+    const String unitPath(getCanonicalPath(file));
+    {
+        std::lock_guard<std::mutex> lock(dependenciesMutex);
+
+        auto it = includesByUnit.find(unitPath);
+        if (it != includesByUnit.end())
+        {
+            includedFiles = it->second;
+            return true;
+        }
+    }
+
+    // fall back to what a previous session recorded
+    BuildManifest::Unit unit;
+    if (! manifest.getUnit(unitPath, unit))
+        return false;
+
+    includedFiles = unit.dependencies;
+    updateDependencies(file, includedFiles, false);
+
+    return includedFiles.size() > 0;
+}
+
+void LiveCodeBuilderImpl::compileDependentsOf(const File& header)
+{
+    SortedSet<String> dependents;
+    {
+        std::lock_guard<std::mutex> lock(dependenciesMutex);
+
+        auto it = unitsByHeader.find(getCanonicalPath(header));
+        if (it != unitsByHeader.end())
+            dependents = it->second;
+    }
+
+    for (int i = 0; i < dependents.size(); i++)
+    {
+        const File file(dependents.getReference(i));
+
+        LOG("Recompiling " << file.getFullPathName() << " after " << header.getFileName() << " changed");
+
+        scheduleCompile(file, editDebounceMs, JobPriority::Dependent);
+    }
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::updatePrecompiledHeader(const File& changedFile)
+{
+    {
+        std::lock_guard<std::mutex> lock(precompiledHeaderMutex);
+
+        if (precompiledHeaderKey.isEmpty() || precompiledHeaderBuilding)
+            return;
+
+        if (changedFile != File())
+        {
+            if (! precompiledHeaderDependencies.contains(getCanonicalPath(changedFile)))
+                return;
+
+            // stop handing out the stale header, compiles go without it until it is rebuilt
+            precompiledHeader = File();
+        }
+        else if (precompiledHeader != File())
+        {
+            return;
+        }
+    }
+
+    // a header left by a previous session is taken up front, only a stat of what it covers,
+    // so the units scheduled next are compiled against it and their cache keys match
+    if (changedFile == File() && reusePrecompiledHeader())
+        return;
+
+    if (activitiesPool.containsJobNamed("__pch"))
+        return;
+
+    // compiles go without the header until it is built, the sooner it is there the better
+    activitiesPool.addJob(new PrecompiledHeaderJob(*this), JobPriority::Interactive);
+}
+
+void LiveCodeBuilderImpl::buildPrecompiledHeader(CompileWorker& worker, const BuildSettings& settings)
+{
+    File pchFile, projectHeader;
+    {
+        std::lock_guard<std::mutex> lock(precompiledHeaderMutex);
+
+        if (precompiledHeaderKey.isEmpty() || precompiledHeader != File())
+            return;
+
+        pchFile = getPrecompiledHeaderFile();
+        projectHeader = juceHeaderFile;
+        precompiledHeaderBuilding = true;
+    }
+
+    const File prefixHeader(pchFile.withFileExtension(".h"));
+    const File dependenciesFile(pchFile.withFileExtension(".deps"));
+    SortedSet<String> dependencies;
+
+    if (! loadPrecompiledHeaderDependencies(pchFile, dependencies))
+    {
+        LOG("Building precompiled header " << pchFile.getFullPathName());
+
+        std::vector<std::string> arguments;
+
+        String prefix;
+        prefix << "// Generated by JUCECompileEngine, do not edit" << newLine;
+
+        const char* standardHeaders[] = {
+            "algorithm", "atomic", "cmath", "cstdio", "cstdlib", "cstring", "functional",
+            "limits", "map", "memory", "mutex", "string", "thread", "utility", "vector"
+        };
+
+        for (auto header : standardHeaders)
+            prefix << "#include <" << header << ">" << newLine;
+
+        if (projectHeader.existsAsFile())
+            prefix << "#include \"" << projectHeader.getFullPathName() << "\"" << newLine;
+
+        // rewriting an identical prefix would touch its timestamp and invalidate the header
+        pchFile.getParentDirectory().createDirectory();
+        if (prefixHeader.loadFileAsString() != prefix)
+            prefixHeader.replaceWithText(prefix);
+
+        if (std::unique_ptr<CompilerInvocation> compilerInvocation = createCompilerInvocation(worker, settings, prefixHeader, File(), OptimisationTier::Fast, arguments))
+        {
+            compilerInvocation->getFrontendOpts().OutputFile = pchFile.getFullPathName().toStdString();
+
+            CompilerInstance& compilerInstance = *worker.compilerInstance;
+            compilerInstance.setInvocation(compilerInvocation.release());
+            compilerInstance.createDiagnostics(worker.diagClient, false);
+            compilerInstance.setSourceManager(nullptr);
+            compilerInstance.setFileManager(nullptr);
+
+            GeneratePrecompiledHeaderAction action(dependencies);
+            if (compilerInstance.ExecuteAction(action) && pchFile.existsAsFile())
+            {
+                dependenciesFile.replaceWithText(StringArray(dependencies.begin(), dependencies.size()).joinIntoString("\n"));
+            }
+            else
+            {
+                LOG("Unable to build precompiled header " << pchFile.getFullPathName());
+
+                pchFile.deleteFile();
+                dependencies.clear();
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(precompiledHeaderMutex);
+
+        // the build info may have changed while this one was building
+        if (pchFile == getPrecompiledHeaderFile() && dependencies.size() > 0)
+        {
+            precompiledHeader = pchFile;
+            precompiledHeaderDependencies.swapWith(dependencies);
+        }
+
+        precompiledHeaderBuilding = false;
+    }
+
+}
+
+bool LiveCodeBuilderImpl::reusePrecompiledHeader()
+{
+    File pchFile;
+    {
+        std::lock_guard<std::mutex> lock(precompiledHeaderMutex);
+
+        if (precompiledHeaderKey.isEmpty() || precompiledHeaderBuilding)
+            return false;
+
+        if (precompiledHeader != File())
+            return true;
+
+        pchFile = getPrecompiledHeaderFile();
+    }
+
+    SortedSet<String> dependencies;
+    if (! loadPrecompiledHeaderDependencies(pchFile, dependencies))
+        return false;
+
+    std::lock_guard<std::mutex> lock(precompiledHeaderMutex);
+
+    // the build info may have changed meanwhile
+    if (pchFile != getPrecompiledHeaderFile() || precompiledHeaderBuilding)
+        return false;
+
+    precompiledHeader = pchFile;
+    precompiledHeaderDependencies.swapWith(dependencies);
+    return true;
+}
+
+bool LiveCodeBuilderImpl::loadPrecompiledHeaderDependencies(const File& pchFile, SortedSet<String>& dependencies) const
+{
+    // a header built in a previous session is still good if nothing it covers changed since
+    const File dependenciesFile(pchFile.withFileExtension(".deps"));
+    if (! pchFile.existsAsFile() || ! dependenciesFile.existsAsFile())
+        return false;
+
+    StringArray lines;
+    dependenciesFile.readLines(lines);
+    for (int i = 0; i < lines.size(); i++)
+        if (lines[i].isNotEmpty())
+            dependencies.add(lines[i]);
+
+    if (dependencies.size() > 0 && isPrecompiledHeaderUpToDate(pchFile, dependencies))
+        return true;
+
+    dependencies.clear();
+    return false;
+}
+
+bool LiveCodeBuilderImpl::isPrecompiledHeaderUpToDate(const File& pchFile, const SortedSet<String>& dependencies) const
+{
+    const Time pchTime(pchFile.getLastModificationTime());
+
+    for (int i = 0; i < dependencies.size(); i++)
+    {
+        const File dependency(dependencies.getReference(i));
+        if (! dependency.existsAsFile() || dependency.getLastModificationTime() > pchTime)
+            return false;
+    }
+
+    return true;
+}
+
+bool LiveCodeBuilderImpl::shouldUsePrecompiledHeader(const File& file)
+{
+    // The header is built as C++, objective-c++ and plain c can't use it
+    if (! file.hasFileExtension("cpp;cc;cxx"))
+        return false;
+
+    std::lock_guard<std::mutex> pchLock(precompiledHeaderMutex);
+
+    // The juce module wrappers set configuration macros before including the module headers,
+    // so pulling those headers in up front would change their meaning
+    if (juceHeaderFile != File() && file.isAChildOf(juceHeaderFile.getParentDirectory()))
+        return false;
+
+    // The header is built from the files on disk, unsaved edits to any of them must be parsed again
+    std::lock_guard<std::mutex> documentsLock(documentsMutex);
+
+    for (auto& document : documents)
+    {
+        if (precompiledHeaderDependencies.contains(getCanonicalPath(File(document.first))))
+            return false;
+    }
+
+    return true;
+}
+
+File LiveCodeBuilderImpl::getPrecompiledHeader()
+{
+    // while it is building there is none, waiting for it would keep the worker from compiling
+    std::lock_guard<std::mutex> lock(precompiledHeaderMutex);
+    return precompiledHeader;
+}
+
+File LiveCodeBuilderImpl::getPrecompiledHeaderFile() const
+{
+    return juceCacheFolder.getChildFile("pch").getChildFile(precompiledHeaderKey).withFileExtension(".pch");
+}
+
+//==============================================================================
+void LiveCodeBuilderImpl::sendMessage(const ValueTree& tree)
+{
+    if (sendMessageFunction != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(sendMutex);
+
+        // the buffer keeps its allocation from one message to the next
+        sendBuffer.reset();
+        tree.writeToStream(sendBuffer);
+
+        sendMessageFunction(callbackUserInfo, sendBuffer.getData(), sendBuffer.getDataSize());
+    }
+}
+
+//==============================================================================
+File LiveCodeBuilderImpl::getCacheBitCodeFile(const String& key) const
+{
+    return juceCacheFolder.getChildFile("objects")
+                          .getChildFile(key.substring(0, 2))
+                          .getChildFile(key + ".bc");
+}
+
+File LiveCodeBuilderImpl::getCacheObjectFile(const String& key) const
+{
+    jassert(liveJIT != nullptr);
+
+    // next to the bitcode it was generated from, one per target the JIT generates code for
+    return getCacheBitCodeFile(key).getSiblingFile(key + "-" + liveJIT->getTargetKey() + ".o");
+}
+
+void LiveCodeBuilderImpl::cacheObject(const String& key)
+{
+    // the JIT is created by the launch queueing this, and kept from then on
+    const File objectFile(getCacheObjectFile(key));
+    const File bitcodeFile(getCacheBitCodeFile(key));
+    if (objectFile.existsAsFile() || ! bitcodeFile.existsAsFile())
+        return;
+
+    // a context of its own, the module never meets the linking context or the one of the launch
+    llvm::LLVMContext objectContext;
+    llvm::SMDiagnostic diag;
+    ModulePtr module(llvm::parseIRFile(bitcodeFile.getFullPathName().toRawUTF8(), diag, objectContext));
+    if (! module)
+    {
+        LOG("Unable to load bitcode " << bitcodeFile.getFullPathName());
+        return;
+    }
 
-    sendActivityListUpdate();
+    if (liveJIT->cacheObject(key, *module, objectFile))
+        ++statistics.objectsCached;
+    else
+        LOG("Unable to generate code for " << bitcodeFile.getFullPathName());
 }
 
-//==============================================================================
-void LiveCodeBuilderImpl::fileReset(const File& file)
+void LiveCodeBuilderImpl::updateManifest(const File& file,
+                                         const String& sourceHash,
+                                         const std::vector<std::string>& arguments,
+                                         const String& key,
+                                         OptimisationTier tier,
+                                         uint32 compileMilliseconds)
 {
-    // delete cached module
+    MemoryOutputStream flags;
+    for (auto& argument : arguments)
+        flags << argument.c_str() << "\n";
+
+    const String bitcodePath(getCacheBitCodeFile(key).getRelativePathFrom(juceCacheFolder));
+
+    manifest.updateUnit(getCanonicalPath(file), [&] (BuildManifest::Unit& unit) {
+        unit.sourceHash = sourceHash;
+        unit.flagsHash = FastHash::toHexString(flags.getData(), flags.getDataSize());
+        // the key of the other tier stays, it is checked again before its bitcode is trusted
+        if (tier == OptimisationTier::Optimised)
+            unit.optimisedKey = key;
+        else
+            unit.fastKey = key;
 
-    if (getCacheSourceFile(file).existsAsFile())
-        getCacheSourceFile(file).deleteFile();
+        unit.isOptimised = tier == OptimisationTier::Optimised;
+        unit.bitcodeFile = bitcodePath;
+        unit.objectFile = String();
 
-    if (getCacheBitCodeFile(file).existsAsFile())
-        getCacheBitCodeFile(file).deleteFile();
+        // a cache hit says nothing about how long the unit takes, keep the last real compile
+        if (compileMilliseconds > 0)
+            unit.compileMilliseconds = compileMilliseconds;
+    });
 
-    sendActivityListUpdate();
+    scheduleIndexSave();
 }
 
-//==============================================================================
-void LiveCodeBuilderImpl::reloadComponents()
+void LiveCodeBuilderImpl::scheduleIndexSave()
 {
-    // TODO
+    // a build writes the index once, after its last unit came in
+    if (! indexSavePending.exchange(true))
+        activitiesPool.addJob(new SaveIndexJob(*this), JobPriority::Background, Time::getMillisecondCounter() + (uint32) indexSaveDelayMs);
 }
 
-//==============================================================================
-void LiveCodeBuilderImpl::cleanAll()
+void LiveCodeBuilderImpl::saveIndex()
 {
-    activitiesPool.addJob(new CleanAllJob(*this), true);
+    // the save job and a launch may both get here, each snapshot is renamed in place before the
+    // next one is taken, so an older one can never land over a newer one
+    std::lock_guard<std::mutex> lock(indexSaveMutex);
 
-    sendActivityListUpdate();
+    // cleared first, a change made while writing schedules the next save
+    indexSavePending = false;
+
+    saveFileHashes();
+    manifest.save();
 }
 
 //==============================================================================
-void LiveCodeBuilderImpl::launchApp()
+String LiveCodeBuilderImpl::getCacheKey(const String& sourceHash,
+                                        const std::vector<std::string>& arguments,
+                                        const SortedSet<String>& includedFiles)
 {
-    //activitiesPool.addJob(new RunAppJob(*this), true);
+    MemoryOutputStream keySource;
+    keySource << getCompilerIdentity() << "\n" << sourceHash << "\n";
 
-    sendActivityListUpdate();
+    for (auto& argument : arguments)
+        keySource << argument.c_str() << "\n";
 
-    runApp();
+    for (int i = 0; i < includedFiles.size(); i++)
+    {
+        const String& path = includedFiles.getReference(i);
+        keySource << path << "\n" << getFileContentHash(File(path)) << "\n";
+    }
+
+    return FastHash::toHexString(keySource.getData(), keySource.getDataSize());
 }
 
-void LiveCodeBuilderImpl::runApp()
+String LiveCodeBuilderImpl::getFileContentHash(const File& file)
 {
-    std::lock_guard<std::mutex> lock(modulesMutex);
+    if (SourceBuffer::Ptr liveText = getLiveText(file))
+        return liveText->getHash();
 
-    if (modules.size() > 0 && modules.size() == compileUnits.size())
-    {
-        sendMessage(ValueTree(MessageTypes::LAUNCHED));
+    const String path(file.getFullPathName());
 
-        llvm::Module& m = *modules[0];
+    // a missing file hashes to an empty string, which still changes any key it is part of
+    FileHash status;
+    if (! getFileStatus(file, status))
+        return String();
 
-        // link modules
-        for (int i = 1; i < modules.size(); i++)
-            llvm::Linker::linkModules(m, std::move(modules[i]));
+    {
+        std::lock_guard<std::mutex> lock(hashesMutex);
 
-        // build execution engine
-        std::string errorString;
-        std::unique_ptr<llvm::ExecutionEngine> executionEngine(createExecutionEngine(std::move(modules[0]), &errorString));
-        if (! executionEngine)
+        auto it = fileHashes.find(path);
+        if (it != fileHashes.end()
+            && it->second.modificationTime == status.modificationTime
+            && it->second.size == status.size
+            && it->second.identity == status.identity)
         {
-            llvm::errs() << "unable to make execution engine: " << errorString << "\n";
-
-            LOG("unable to make execution engine " << String::fromUTF8(errorString.c_str()));
-            return;
+            return it->second.hash;
         }
+    }
 
-        executionEngine->finalizeObject();
-        executionEngine->runStaticConstructorsDestructors(false);
+    status.hash = FastHash::forFile(file);
 
-        llvm::Function* mainFunction = executionEngine->FindFunctionNamed("main");
-        if (! mainFunction)
-        {
-            llvm::errs() << "'main' function not found in module.\n";
+    std::lock_guard<std::mutex> lock(hashesMutex);
+    fileHashes[path] = status;
+    fileHashesChanged = true;
 
-            return;
-        }
+    return status.hash;
+}
 
-        std::vector<std::string> args;
-        args.push_back("app");
-        const int result = executionEngine->runFunctionAsMain(mainFunction, args, nullptr);
-        if (result != 0)
-        {
-            llvm::errs() << "Error executing main.\n";
+bool LiveCodeBuilderImpl::getFileStatus(const File& file, FileHash& status)
+{
+    llvm::sys::fs::file_status fileStatus;
+    if (llvm::sys::fs::status(file.getFullPathName().toRawUTF8(), fileStatus) || ! llvm::sys::fs::is_regular_file(fileStatus))
+        return false;
 
-            return;
-        }
+    const llvm::sys::TimeValue modificationTime(fileStatus.getLastModificationTime());
 
-        executionEngine->runStaticConstructorsDestructors(true);
-    }
+    status.modificationTime = modificationTime.seconds() * 1000000000 + modificationTime.nanoseconds();
+    status.size = (int64) fileStatus.getSize();
+    status.identity = fileStatus.getUniqueID().getFile();
+    return true;
 }
 
-//==============================================================================
-void LiveCodeBuilderImpl::pong()
+void LiveCodeBuilderImpl::loadFileHashes()
 {
-    sendMessage(ValueTree(MessageTypes::PING));
-}
+    FileInputStream input(juceCacheFolder.getChildFile("hashes.bin"));
+    if (! input.openedOk() || input.readInt() != fileHashesMagic)
+        return;
 
-//==============================================================================
-void LiveCodeBuilderImpl::foregroundProcess(bool parentActive)
-{
-}
+    std::lock_guard<std::mutex> lock(hashesMutex);
 
-//==============================================================================
-void LiveCodeBuilderImpl::sendCompileProject()
-{
-    messageQueue.push(MessageEvents::CompileProject);
-}
+    for (int i = input.readInt(); i > 0 && ! input.isExhausted(); --i)
+    {
+        const String path(input.readString());
 
-void LiveCodeBuilderImpl::sendActivityListUpdate()
-{
-    messageQueue.push(MessageEvents::UpdateActivities);
+        FileHash& status = fileHashes[path];
+        status.modificationTime = input.readInt64();
+        status.size = input.readInt64();
+        status.identity = (uint64) input.readInt64();
+        status.hash = input.readString();
+    }
 }
 
-//==============================================================================
-void LiveCodeBuilderImpl::run()
+void LiveCodeBuilderImpl::saveFileHashes()
 {
-    while (! threadShouldExit())
+    MemoryOutputStream output;
     {
-        MessageEvents event;
-        messageQueue.waitAndPop(event);
+        std::lock_guard<std::mutex> lock(hashesMutex);
+
+        if (! fileHashesChanged)
+            return;
 
-        if (threadShouldExit())
-            break;
+        output.writeInt(fileHashesMagic);
+        output.writeInt((int) fileHashes.size());
 
-        do
+        for (auto& entry : fileHashes)
         {
-            switch (event)
-            {
-                case MessageEvents::CompileProject:
-                {
-                    sendActivityListUpdate();
-                    buildProjectIfNeeded();
-                    break;
-                }
+            output.writeString(entry.first);
+            output.writeInt64(entry.second.modificationTime);
+            output.writeInt64(entry.second.size);
+            output.writeInt64((int64) entry.second.identity);
+            output.writeString(entry.second.hash);
+        }
 
-                case MessageEvents::UpdateActivities:
-                {
-                    StringArray list = activitiesPool.getNamesOfAllJobs(false);
-                    StringArray finalList;
-                    for (int i = 0; i < list.size(); i++)
-                    {
-                        String& job = list.getReference(i);
-                        if (job.endsWithIgnoreCase(".cpp") || job.endsWithIgnoreCase(".c") || job.endsWithIgnoreCase(".mm"))
-                            finalList.add("Compile " + job);
-                        else if (! job.startsWith("__"))
-                            finalList.add(job);
-                    }
-
-                    ValueTree v(MessageTypes::ACTIVITY_LIST);
-                    v.setProperty(Ids::list, concatenateListOfStrings(finalList), nullptr);
-                    sendMessage(v);
+        fileHashesChanged = false;
+    }
 
-                    break;
-                }
+    juceCacheFolder.getChildFile("hashes.bin").replaceWithData(output.getData(), output.getDataSize());
+}
 
-                default:
-                {
-                    break;
-                }
-            }
-        } while (messageQueue.tryAndPop(event));
-    }
+String LiveCodeBuilderImpl::getCompilerIdentity()
+{
+    return String(clang::getClangFullVersion()) + " " + String(llvm::sys::getProcessTriple()) + " bitcode-cache-1";
 }
 
 //==============================================================================
-CompilationStatus LiveCodeBuilderImpl::compileFileIfNeeded(const File& file,
-                                                           const String& string,
-                                                           bool useString,
-                                                           const Array<LiveCodeChange>& changes,
-                                                           bool useChanges,
-                                                           String& errorString)
+ModulePtr LiveCodeBuilderImpl::loadModuleIntoLinkingContext(llvm::MemoryBufferRef bitcode)
 {
-    std::lock_guard<std::mutex> lock(modulesMutex);
-
-    errorString = String();
+    std::lock_guard<std::mutex> lock(contextMutex);
 
-    if (file.getFileExtension().equalsIgnoreCase(".h"))
+    llvm::ErrorOr<ModulePtr> module = llvm::parseBitcodeFile(bitcode, *context);
+    if (! module)
     {
-        // TODO - this will need to rebuild some other files that includes that
-
-        return CompilationStatus::NotNeeded;
+        LOG("Unable to load bitcode for " << bitcode.getBufferIdentifier().str());
+        return ModulePtr();
     }
 
-    bool fileHasChanged = true;
-    File cachedSource(getCacheSourceFile(file));
+    return std::move(module.get());
+}
 
-    if (useString)
-    {
-        if (cachedSource.existsAsFile())
-        {
-            String cachedText;
+std::unique_ptr<llvm::MemoryBuffer> LiveCodeBuilderImpl::mapBitcodeFile(const File& bitcodeFile)
+{
+    // without the null terminator requirement big files are mapped rather than copied to the heap
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+        llvm::MemoryBuffer::getFile(bitcodeFile.getFullPathName().toRawUTF8(), -1, false);
 
-            if (ScopedPointer<InputStream> is = cachedSource.createInputStream())
-                cachedText = is->readEntireStreamAsString();
+    if (! buffer)
+        return nullptr;
 
-            if (cachedText != string)
-                cachedSource.deleteFile();
-        }
+    return std::move(buffer.get());
+}
 
-        if (! cachedSource.existsAsFile())
-        {
-            if (ScopedPointer<OutputStream> os = cachedSource.createOutputStream())
-                os->writeText(string, false, false);
-        }
-    }
-    else
+ModulePtr LiveCodeBuilderImpl::readLazyModule(std::unique_ptr<llvm::MemoryBuffer> bitcode)
+{
+    if (bitcode == nullptr)
+        return ModulePtr();
+
+    const std::string name(bitcode->getBufferIdentifier().str());
+
+    // only the globals and the function prototypes are read here, a function body is parsed
+    // when something asks for it, the module keeps the mapping alive until then
+    llvm::ErrorOr<ModulePtr> module = llvm::getLazyBitcodeModule(std::move(bitcode), *context, true);
+    if (! module)
     {
-        if (! cachedSource.existsAsFile())
-            file.copyFileTo(cachedSource);
+        LOG("Unable to load bitcode for " << name);
+        return ModulePtr();
     }
 
-    if (useChanges && changes.size())
-    {
-        String content;
+    return std::move(module.get());
+}
 
-        if (ScopedPointer<InputStream> is = file.createInputStream())
-            content = is->readEntireStreamAsString();
+ModulePtr LiveCodeBuilderImpl::loadLazyModule(const File& bitcodeFile)
+{
+    // the file is opened and mapped by the calling thread, only reading the module needs the context
+    std::unique_ptr<llvm::MemoryBuffer> bitcode(mapBitcodeFile(bitcodeFile));
+    if (bitcode == nullptr)
+        return ModulePtr();
+
+    std::lock_guard<std::mutex> lock(contextMutex);
+    return readLazyModule(std::move(bitcode));
+}
 
-        for (int i = 0; i < changes.size(); i++)
-            content = content.replaceSection(changes[i].start, changes[i].end - changes[i].start, changes[i].text);
+//==============================================================================
+void LiveCodeBuilderImpl::addModule(const File& file, const String& key, ModulePtr module, size_t bitcodeSize,
+                                    OptimisationTier tier, bool isVerified)
+{
+    LoadedModule loaded;
+    loaded.key = key;
+    loaded.tier = tier;
+    loaded.isVerified = isVerified;
+    loaded.bitcodeSize = bitcodeSize;
+    loaded.numGlobals = (int) module->getGlobalList().size();
+
+    // counted before the module is shared, nobody else can touch it yet
+    for (const llvm::Function& function : *module)
+    {
+        if (function.isDeclaration())
+            continue;
 
-        if (cachedSource.existsAsFile())
-            cachedSource.deleteFile();
+        ++loaded.numFunctions;
 
-        if (ScopedPointer<OutputStream> os = cachedSource.createOutputStream())
-            os->writeText(content, false, false);
+        // bodies of modules mapped from the cache are not parsed yet and count no instructions
+        for (const llvm::BasicBlock& block : function)
+            loaded.numInstructions += (int64) block.size();
     }
 
-    if (cachedSource.existsAsFile())
-    {
-        MD5 cachedFileMD5(cachedSource);
-        MD5 fileMD5(file);
+    loaded.module = std::move(module);
 
-        if (fileMD5 == cachedFileMD5)
-            fileHasChanged = false;
-    }
+    std::lock_guard<std::mutex> lock(modulesMutex);
+
+    const String unitPath(getCanonicalPath(file));
 
-    bool moduleIsAlreadyCompiled = false;
-    for (auto&& module : modules)
+    // a prefetch finishing after BUILDINFO must not bring back a unit gone from the project
+    if (! isVerified && hasProjectUnits && projectUnitPaths.find(unitPath) == projectUnitPaths.end())
     {
-        if (module && module->getSourceFileName().compare(cachedSource.getFullPathName().toStdString()) == 0)
-        {
-            moduleIsAlreadyCompiled = true;
-            break;
-        }
+        std::lock_guard<std::mutex> contextLock(contextMutex);
+        loaded.module.reset();
+        return;
     }
 
-    if (! fileHasChanged && getCacheBitCodeFile(file).existsAsFile())
-    {
-        llvm::SMDiagnostic diag;
-        if (ModulePtr module = llvm::parseIRFile(getCacheBitCodeFile(file).getFullPathName().toRawUTF8(), diag, *context))
-        {
-            module->setSourceFileName(cachedSource.getFullPathName().toRawUTF8());
-            modules.push_back(std::move(module));
+    // the previous module of the unit is swapped out in one step and destroyed afterwards
+    LoadedModule& entry = modules[unitPath];
 
-            return CompilationStatus::NotNeeded;
-        }
-    }
+    // a prefetched module never replaces one a compile already put there
+    if (isVerified || ! entry.module)
+        std::swap(entry, loaded);
 
-    if (fileHasChanged || ! moduleIsAlreadyCompiled)
+    if (loaded.module)
     {
-        LOG("Compiling " << file.getFullPathName());
+        std::lock_guard<std::mutex> contextLock(contextMutex);
+        loaded.module.reset();
+    }
+}
 
-        if (ModulePtr module = compileFile(file))
-        {
-            if (getCacheBitCodeFile(file).existsAsFile())
-                getCacheBitCodeFile(file).deleteFile();
+bool LiveCodeBuilderImpl::isModuleLoaded(const File& file, const String& key)
+{
+    std::lock_guard<std::mutex> lock(modulesMutex);
 
-            std::error_code errorCode;
-            llvm::raw_fd_ostream outputFile(getCacheBitCodeFile(file).getFullPathName().toRawUTF8(), errorCode, llvm::sys::fs::F_None);
-            llvm::WriteBitcodeToFile(module.get(), outputFile);
-            outputFile.flush();
+    auto it = modules.find(getCanonicalPath(file));
+    if (it == modules.end() || it->second.key != key)
+        return false;
 
-            modules.push_back(std::move(module));
+    // the key covers the sources, headers and flags, a prefetched module matching it is current
+    it->second.isVerified = true;
+    return true;
+}
 
-            return CompilationStatus::Ok;
-        }
-        else
-        {
-            return CompilationStatus::Error;
-        }
-    }
+bool LiveCodeBuilderImpl::isModuleLoaded(const File& file)
+{
+    std::lock_guard<std::mutex> lock(modulesMutex);
 
-    return CompilationStatus::NotNeeded;
+    auto it = modules.find(getCanonicalPath(file));
+    return it != modules.end() && it->second.isVerified;
 }
 
-//==============================================================================
-void LiveCodeBuilderImpl::buildProjectIfNeeded()
+bool LiveCodeBuilderImpl::isModuleOptimised(const File& file)
 {
     std::lock_guard<std::mutex> lock(modulesMutex);
 
-    int numberOfFilesToCompile = 0;
+    auto it = modules.find(getCanonicalPath(file));
+    return it != modules.end() && it->second.tier == OptimisationTier::Optimised;
+}
 
-    // compile units
-    for (int i = 0; i < compileUnits.size(); i++)
-    {
-        File& file = compileUnits.getReference(i);
-        bool moduleFound = false;
+void LiveCodeBuilderImpl::evictRemovedModules(const BuildSettings& settings)
+{
+    std::unordered_map<String, bool, StringHash> unitPaths;
+    for (int i = 0; i < settings.compileUnits.size(); i++)
+        unitPaths[getCanonicalPath(settings.compileUnits.getReference(i))] = true;
+
+    std::lock_guard<std::mutex> lock(modulesMutex);
+    std::lock_guard<std::mutex> contextLock(contextMutex);
+
+    projectUnitPaths = unitPaths;
+    hasProjectUnits = true;
 
-        for (auto&& module : modules)
+    for (auto it = modules.begin(); it != modules.end();)
+    {
+        if (unitPaths.find(it->first) == unitPaths.end())
         {
-            if (module->getSourceFileName().compare(file.getFullPathName().toStdString()) == 0)
-            {
-                moduleFound = true;
-                break;
-            }
+            LOG("Unloading " << it->first);
+            it = modules.erase(it);
         }
-
-        if (! moduleFound)
+        else
         {
-            fileChanged(file);
-
-            ++numberOfFilesToCompile;
+            ++it;
         }
     }
-
-    if (compileUnits.size() > 0 && numberOfFilesToCompile == 0)
-    {
-        activitiesPool.addJob(new ActivityListUpdateJob(*this), true);
-    }
-
-    sendActivityListUpdate();
 }
 
-//==============================================================================
-void LiveCodeBuilderImpl::cleanAllFiles()
+void LiveCodeBuilderImpl::clearModules()
 {
-    {
     std::lock_guard<std::mutex> lock(modulesMutex);
-    modules.clear();
-
-    DirectoryIterator it(juceCacheFolder, false);
-    while (it.next())
-    {
-        File file = it.getFile();
-        file.deleteRecursively();
-    }
+    std::lock_guard<std::mutex> contextLock(contextMutex);
 
-    compilerInstance->clearOutputFiles(true);
-    }
+    modules.clear();
 }
 
-//==============================================================================
-void LiveCodeBuilderImpl::sendMessage(const ValueTree& tree)
+void LiveCodeBuilderImpl::prefetchModules()
 {
-    if (sendMessageFunction != nullptr)
+    // one job per unit, the files are opened and mapped in parallel, the modules are
+    // read one at a time, they all go into the linking context
+    const StringArray unitPaths(manifest.getUnitPaths());
+    for (int i = 0; i < unitPaths.size(); i++)
     {
-        MemoryOutputStream out;
-        tree.writeToStream(out);
-        MemoryBlock mb = out.getMemoryBlock();
+        BuildManifest::Unit unit;
+        if (! manifest.getUnit(unitPaths[i], unit))
+            continue;
+
+        // the optimised module when its bitcode is still there, else the fast one
+        OptimisationTier tier(unit.isOptimised ? OptimisationTier::Optimised : OptimisationTier::Fast);
+        String key(unit.getKey());
+
+        if (tier == OptimisationTier::Optimised && ! getCacheBitCodeFile(key).existsAsFile())
+        {
+            tier = OptimisationTier::Fast;
+            key = unit.fastKey;
+        }
 
-        sendMessageFunction(callbackUserInfo, mb.getData(), mb.getSize());
+        if (key.isNotEmpty())
+            activitiesPool.addJob(new PrefetchModuleJob(*this, File(unitPaths[i]), key, tier), JobPriority::Background);
     }
 }
 
-//==============================================================================
-File LiveCodeBuilderImpl::getCacheSourceFile(const File& file) const
+void LiveCodeBuilderImpl::prefetchModule(const File& file, const String& key, OptimisationTier tier)
 {
-    return juceCacheFolder.getChildFile(file.getFileName());
-}
+    const File bitcodeFile(getCacheBitCodeFile(key));
+    if (! bitcodeFile.existsAsFile())
+        return;
 
-File LiveCodeBuilderImpl::getCacheBitCodeFile(const File& file) const
-{
-    return juceCacheFolder.getChildFile(file.getFileNameWithoutExtension()).withFileExtension(".bc");
+    ModulePtr module(loadLazyModule(bitcodeFile));
+
+    // it only counts as loaded once the first compile check of the unit agrees on its key
+    if (module)
+        addModule(file, key, std::move(module), (size_t) bitcodeFile.getSize(), tier, false);
 }
 
-DiagnosticReporter* LiveCodeBuilderImpl::getDiagnostics()
+StringPairArray LiveCodeBuilderImpl::getModuleStatistics()
 {
-    return diagClient;
+    std::lock_guard<std::mutex> lock(modulesMutex);
+
+    StringPairArray stats;
+    for (auto& entry : modules)
+    {
+        const LoadedModule& loaded = entry.second;
+
+        String description;
+        description << (loaded.tier == OptimisationTier::Fast ? "-O0, " : "-O2, ")
+                    << loaded.numFunctions << " functions, "
+                    << loaded.numGlobals << " globals, "
+                    << loaded.numInstructions << " instructions, "
+                    << File::descriptionOfSizeInBytes((int64) loaded.bitcodeSize) << " of bitcode";
+
+        stats.set(entry.first, description);
+    }
+
+    return stats;
 }
 
 //==============================================================================
-ModulePtr LiveCodeBuilderImpl::compileFile(const File& file)
+ModulePtr LiveCodeBuilderImpl::compileFile(CompileWorker& worker,
+                                           std::unique_ptr<CompilerInvocation> compilerInvocation,
+                                           const std::atomic<bool>& cancelled,
+                                           SortedSet<String>& includedFiles)
 {
-    std::unique_ptr<CodeGenAction> codeGenAction(generateCode(file));
+    std::unique_ptr<CodeGenAction> codeGenAction(generateCode(worker, std::move(compilerInvocation), cancelled, includedFiles));
     if (codeGenAction)
         return std::move(codeGenAction->takeModule());
     return ModulePtr();
 }
 
 //==============================================================================
-std::unique_ptr<CodeGenAction> LiveCodeBuilderImpl::generateCode(const File& file)
+std::unique_ptr<CodeGenAction> LiveCodeBuilderImpl::generateCode(CompileWorker& worker,
+                                                                 std::unique_ptr<CompilerInvocation> compilerInvocation,
+                                                                 const std::atomic<bool>& cancelled,
+                                                                 SortedSet<String>& includedFiles)
 {
-    // Create compiler invocation
-    std::unique_ptr<CompilerInvocation> compilerInvocation(createCompilerInvocation(file));
-    if (! compilerInvocation)
-    {
-        return std::unique_ptr<CodeGenAction>();
-    }
-
     // Set the invocation to the instance
-    compilerInstance->setInvocation(compilerInvocation.release());
+    CompilerInstance& compilerInstance = *worker.compilerInstance;
+    compilerInstance.setInvocation(compilerInvocation.release());
+
+    // A fresh engine forgets the errors of the previous compile on this worker,
+    // the code generator would otherwise throw away every module after the first failure
+    compilerInstance.createDiagnostics(worker.diagClient, false);
+
+    // Start from fresh file and source managers so files changed on disk are read again
+    compilerInstance.setSourceManager(nullptr);
+    compilerInstance.setFileManager(nullptr);
 
     // Emit a codegen
-    std::unique_ptr<CodeGenAction> codeGenAction(new EmitLLVMOnlyAction(context.get()));
-    if (! compilerInstance->ExecuteAction(*codeGenAction))
+    std::unique_ptr<CodeGenAction> codeGenAction(new LiveCodeGenAction(worker.context.get(), cancelled, includedFiles));
+    if (! compilerInstance.ExecuteAction(*codeGenAction))
     {
         return std::unique_ptr<CodeGenAction>();
     }
@@ -792,7 +3111,108 @@ std::unique_ptr<CodeGenAction> LiveCodeBuilderImpl::generateCode(const File& fil
 }
 
 //==============================================================================
-std::unique_ptr<CompilerInvocation> LiveCodeBuilderImpl::createCompilerInvocation(const File& file)
+std::unique_ptr<CompilerInvocation> LiveCodeBuilderImpl::createCompilerInvocation(CompileWorker& worker,
+                                                                                  const BuildSettings& settings,
+                                                                                  const File& file,
+                                                                                  const File& precompiledHeaderFile,
+                                                                                  OptimisationTier tier,
+                                                                                  std::vector<std::string>& arguments)
+{
+    if (! getCompilerArguments(worker, settings, file, precompiledHeaderFile, tier, arguments))
+        return std::unique_ptr<CompilerInvocation>();
+
+    std::vector<const char*> ccArgs;
+    for (auto& argument : arguments)
+        ccArgs.push_back(argument.c_str());
+
+    auto compilerInvocation = llvm::make_unique<CompilerInvocation>();
+    CompilerInvocation::CreateFromArgs(*compilerInvocation,
+                                       ccArgs.data(),
+                                       ccArgs.data() + ccArgs.size(),
+                                       *worker.diagEngine);
+
+    // Show the invocation, with -v.
+    if (compilerInvocation->getHeaderSearchOpts().Verbose)
+    {
+        llvm::errs() << "clang invocation:\n";
+        for (auto& argument : arguments)
+            llvm::errs() << " \"" << argument << "\"";
+        llvm::errs() << "\n";
+    }
+
+    return compilerInvocation;
+}
+
+bool LiveCodeBuilderImpl::getCompilerArguments(CompileWorker& worker,
+                                               const BuildSettings& settings,
+                                               const File& file,
+                                               const File& precompiledHeaderFile,
+                                               OptimisationTier tier,
+                                               std::vector<std::string>& arguments)
+{
+    // Files of the same language and folder only differ in their own path,
+    // so the driver runs once per kind of file and build info
+    String templateKey;
+    templateKey << (int) settings.generation << "\n"
+                << file.getFileExtension().toLowerCase() << "\n"
+                << (tier == OptimisationTier::Fast ? "-O0" : "-O2") << "\n"
+                << precompiledHeaderFile.getFullPathName() << "\n"
+                << file.getParentDirectory().getFullPathName();
+
+    const std::string filePath(file.getFullPathName().toStdString());
+    const std::string fileName(file.getFileName().toStdString());
+
+    bool hasTemplate = false;
+    {
+        std::lock_guard<std::mutex> lock(argumentTemplatesMutex);
+
+        auto it = argumentTemplates.find(templateKey);
+        if (it != argumentTemplates.end())
+        {
+            arguments = it->second;
+            hasTemplate = true;
+        }
+    }
+
+    if (hasTemplate)
+    {
+        for (auto& argument : arguments)
+        {
+            if (argument == inputPathPlaceholder)
+                argument = filePath;
+            else if (argument == inputNamePlaceholder)
+                argument = fileName;
+        }
+    }
+    else
+    {
+        if (! runCompilerDriver(worker, settings, file, precompiledHeaderFile, tier, arguments))
+            return false;
+
+        std::vector<std::string> argumentTemplate(arguments);
+        for (size_t i = 0; i < argumentTemplate.size(); i++)
+        {
+            if (argumentTemplate[i] == filePath)
+                argumentTemplate[i] = inputPathPlaceholder;
+            else if (argumentTemplate[i] == fileName && i > 0 && argumentTemplate[i - 1] == "-main-file-name")
+                argumentTemplate[i] = inputNamePlaceholder;
+        }
+
+        // a driver run that started before the last BUILDINFO went with the old flags
+        std::lock_guard<std::mutex> lock(argumentTemplatesMutex);
+        if (settings.generation == argumentTemplatesGeneration)
+            argumentTemplates[templateKey] = std::move(argumentTemplate);
+    }
+
+    return true;
+}
+
+bool LiveCodeBuilderImpl::runCompilerDriver(CompileWorker& worker,
+                                            const BuildSettings& settings,
+                                            const File& file,
+                                            const File& precompiledHeaderFile,
+                                            OptimisationTier tier,
+                                            std::vector<std::string>& arguments)
 {
     std::vector<const char*> args;
 
@@ -811,7 +3231,7 @@ std::unique_ptr<CompilerInvocation> LiveCodeBuilderImpl::createCompilerInvocatio
     // syntax only
     args.push_back("-fsyntax-only");
     args.push_back("-fno-use-cxa-atexit");
-    //args.push_back("-O3");
+    args.push_back(tier == OptimisationTier::Fast ? "-O0" : "-O2");
 
     // base includes
     args.push_back("-I/Applications/Xcode.app/Contents/Developer/Toolchains/XcodeDefault.xctoolchain/usr/include/c++/v1");
@@ -824,13 +3244,13 @@ std::unique_ptr<CompilerInvocation> LiveCodeBuilderImpl::createCompilerInvocatio
 
     // compile flags
     args.push_back("-c");
-    for (int i = 0; i < extraCompilerFlags.size(); i++)
-        args.push_back(extraCompilerFlags[i].toRawUTF8());
+    for (int i = 0; i < settings.extraCompilerFlags.size(); i++)
+        args.push_back(settings.extraCompilerFlags[i].toRawUTF8());
 
     // defines
     StringArray definesTemp;
-    for (int i = 0; i < defines.size(); i++) {
-        definesTemp.add("-D" + defines[i]);
+    for (int i = 0; i < settings.defines.size(); i++) {
+        definesTemp.add("-D" + settings.defines[i]);
     }
 
     //args.push_back("-DDEBUG=1");
@@ -845,12 +3265,12 @@ std::unique_ptr<CompilerInvocation> LiveCodeBuilderImpl::createCompilerInvocatio
     String filePathTemp = "-I" + file.getParentDirectory().getFullPathName();
     args.push_back(filePathTemp.toRawUTF8());
 
-    String systemPathTemp = "-I" + systemPath;
-    if (systemPath.isNotEmpty())
+    String systemPathTemp = "-I" + settings.systemPath;
+    if (settings.systemPath.isNotEmpty())
         args.push_back(systemPathTemp.toRawUTF8());
 
-    String userPathTemp = "-I" + userPath;
-    if (userPath.isNotEmpty())
+    String userPathTemp = "-I" + settings.userPath;
+    if (settings.userPath.isNotEmpty())
         args.push_back(userPathTemp.toRawUTF8());
 
     // frameworks
@@ -876,14 +3296,22 @@ std::unique_ptr<CompilerInvocation> LiveCodeBuilderImpl::createCompilerInvocatio
     }
     */
 
+    // precompiled header
+    String precompiledHeaderPath = precompiledHeaderFile.getFullPathName();
+    if (precompiledHeaderFile != File())
+    {
+        args.push_back("-include-pch");
+        args.push_back(precompiledHeaderPath.toRawUTF8());
+    }
+
     // file to compile
-    String filePath = getCacheSourceFile(file).getFullPathName();
+    String filePath = file.getFullPathName();
     args.push_back(filePath.toRawUTF8());
 
     // starts compilation
-    Compilation* compilation = compilerDriver->BuildCompilation(args);
+    std::unique_ptr<Compilation> compilation(worker.compilerDriver->BuildCompilation(args));
     if (! compilation)
-        return std::unique_ptr<CompilerInvocation>();
+        return false;
 
     // We expect to get back exactly one command job, if we didn't something failed.
     const driver::JobList& jobs = compilation->getJobs();
@@ -892,48 +3320,22 @@ std::unique_ptr<CompilerInvocation> LiveCodeBuilderImpl::createCompilerInvocatio
         SmallString<256> msg;
         llvm::raw_svector_ostream stream(msg);
         jobs.Print(stream, "; ", true);
-        diagEngine.Report(diag::err_fe_expected_compiler_job) << stream.str();
+        worker.diagEngine->Report(diag::err_fe_expected_compiler_job) << stream.str();
 
-        return std::unique_ptr<CompilerInvocation>();
+        return false;
     }
 
     const driver::Command& cmd = cast<driver::Command>(*jobs.begin());
     if (llvm::StringRef(cmd.getCreator().getName()) != "clang")
     {
-        diagEngine.Report(diag::err_fe_expected_clang_command);
+        worker.diagEngine->Report(diag::err_fe_expected_clang_command);
 
-        return std::unique_ptr<CompilerInvocation>();
+        return false;
     }
 
     const driver::ArgStringList& ccArgs = cmd.getArguments();
-
-    auto compilerInvocation = llvm::make_unique<CompilerInvocation>();
-    CompilerInvocation::CreateFromArgs(*compilerInvocation,
-                                       const_cast<const char **>(ccArgs.data()),
-                                       const_cast<const char **>(ccArgs.data()) +
-                                       ccArgs.size(),
-                                       diagEngine);
-
-    // Show the invocation, with -v.
-    if (compilerInvocation->getHeaderSearchOpts().Verbose)
-    {
-        llvm::errs() << "clang invocation:\n";
-        jobs.Print(llvm::errs(), "\n", true);
-        llvm::errs() << "\n";
-    }
-
-    return compilerInvocation;
-}
-
-//==============================================================================
-std::unique_ptr<llvm::ExecutionEngine> LiveCodeBuilderImpl::createExecutionEngine(ModulePtr module, std::string* errorString)
-{
-    return std::unique_ptr<llvm::ExecutionEngine>(llvm::EngineBuilder(std::move(module))
-                                                  .setEngineKind(llvm::EngineKind::JIT)
-                                                  .setMCJITMemoryManager(std::unique_ptr<llvm::SectionMemoryManager>(new llvm::SectionMemoryManager()))
-                                                  .setVerifyModules(true)
-                                                  .setErrorStr(errorString)
-                                                  .create());
+    arguments.assign(ccArgs.begin(), ccArgs.end());
+    return true;
 }
 
 //==============================================================================
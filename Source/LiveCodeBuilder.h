@@ -34,20 +34,30 @@
 
 #pragma once
 
+#include "BuildManifest.h"
 #include "Common.h"
+#include "Hashing.h"
+#include "JobScheduler.h"
+#include "LiveJIT.h"
+#include "LiveDocument.h"
 #include "SharedQueue.h"
 
 #undef DEBUG
 #include "clang/CodeGen/CodeGenAction.h"
 #include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/Version.h"
 #include "clang/Driver/Compilation.h"
 #include "clang/Driver/Driver.h"
 #include "clang/Driver/Tool.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/FrontendActions.h"
 #include "clang/Frontend/FrontendDiagnostic.h"
-#include "clang/Frontend/TextDiagnosticPrinter.h"
-#include "clang/Frontend/TextDiagnostic.h"
+#include "clang/Frontend/MultiplexConsumer.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Lex/PreprocessorOptions.h"
 #include "clang/Serialization/ASTReader.h"
 
 #include "llvm/ADT/SmallString.h"
@@ -55,24 +65,28 @@
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
-#include "llvm/ExecutionEngine/MCJIT.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IRReader/IRReader.h"
-#include "llvm/Linker/Linker.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <unordered_map>
 
 //==============================================================================
 using namespace clang;
 using namespace clang::driver;
 
 using ModulePtr = std::unique_ptr<llvm::Module>;
-using ModulePtrList = std::vector<ModulePtr>;
 
 //==============================================================================
 std::string getExecutablePath(const char* Argv0);
@@ -82,7 +96,16 @@ enum class CompilationStatus
 {
     NotNeeded,
     Ok,
-    Error
+    Error,
+    Cancelled
+};
+
+//==============================================================================
+/** Edits are compiled fast for quick feedback, optimised code replaces them once the file is left alone */
+enum class OptimisationTier
+{
+    Fast,       // -O0
+    Optimised   // -O2
 };
 
 //==============================================================================
@@ -91,19 +114,56 @@ enum class MessageEvents
     NoEvent,
     ExitThread,
     CompileProject,
-    UpdateActivities
+    UpdateActivities,
+    UpdateDiagnostics
 };
 
 //==============================================================================
-struct LiveCodeChange
+class CompileJob;
+class DiagnosticReporter;
+class SyntaxCheckJob;
+class LiveCodeBuilderImpl;
+
+//==============================================================================
+/** The project as the last BUILDINFO described it, never changed once published.
+
+    A new BUILDINFO publishes a new one, jobs keep the one they took when they started.
+*/
+struct BuildSettings : public ReferenceCountedObject
 {
-    int start;
-    int end;
-    String text;
+    typedef ReferenceCountedObjectPtr<BuildSettings> Ptr;
+
+    uint32 generation = 0;
+    String systemPath;
+    String userPath;
+    StringArray defines;
+    StringArray extraCompilerFlags;
+    String extraDLLs;
+    String juceModulesFolder;
+    String utilsCppInclude;
+    Array<File> compileUnits;
+    Array<File> userFiles;
 };
 
 //==============================================================================
-class DiagnosticReporter;
+/** Everything clang needs to compile a single translation unit.
+
+    Each pool thread borrows one worker for the duration of a compile job, so
+    several files can go through the frontend and codegen at the same time.
+*/
+struct CompileWorker
+{
+    CompileWorker(LiveCodeBuilderImpl& builder, const std::string& targetTriple);
+    ~CompileWorker();
+
+    IntrusiveRefCntPtr<DiagnosticOptions> diagOpts;
+    DiagnosticReporter* diagClient;
+    IntrusiveRefCntPtr<DiagnosticIDs> diagIdentifier;
+    std::unique_ptr<DiagnosticsEngine> diagEngine;
+    std::unique_ptr<Driver> compilerDriver;
+    std::unique_ptr<CompilerInstance> compilerInstance;
+    std::unique_ptr<llvm::LLVMContext> context;
+};
 
 //==============================================================================
 class LiveCodeBuilderImpl : public Thread
@@ -119,7 +179,7 @@ public:
     /** Public interface from shared library */
     void setBuildInfo(const ValueTree& data);
 
-    void fileUpdated(const File& file, const String& optionalText = String());
+    void fileUpdated(const File& file, SourceBuffer::Ptr text);
 
     void fileChanged(const File& file, const Array<LiveCodeChange>& changes = Array<LiveCodeChange>());
 
@@ -145,20 +205,32 @@ public:
     /** Post messages to Projucer */
     void sendMessage(const ValueTree& tree);
 
-    /** Get the diagnostics object */
-    DiagnosticReporter* getDiagnostics();
+    /** Counters of the compiles done since the builder was created */
+    StringPairArray getStatistics();
+
+    /** Size of each module currently loaded, keyed by the path of its compile unit */
+    StringPairArray getModuleStatistics();
+
+    /** The one form of a path every map of units and headers is keyed by: links followed, no "." or ".." left */
+    static String getCanonicalPath(const File& file);
 
 private:
     friend class CompileJob;
+    friend class DiagnosticReporter;
+    friend class SyntaxCheckJob;
     friend class LinkJob;
     friend class CleanAllJob;
     friend class RunAppJob;
-
-    CompilationStatus compileFileIfNeeded(const File& file,
-                                          const String& string,
-                                          bool useString,
-                                          const Array<LiveCodeChange>& changes,
-                                          bool useChanges,
+    friend class PrecompiledHeaderJob;
+    friend class PrefetchModuleJob;
+    friend class SaveIndexJob;
+    friend class ObjectCacheJob;
+
+    CompilationStatus compileFileIfNeeded(CompileWorker& worker,
+                                          const BuildSettings& settings,
+                                          const File& file,
+                                          OptimisationTier tier,
+                                          const std::atomic<bool>& cancelled,
                                           String& errorString);
 
     void buildProjectIfNeeded();
@@ -166,43 +238,354 @@ private:
 
     void runApp();
 
-    File getCacheSourceFile(const File& file) const;
-    File getCacheBitCodeFile(const File& file) const;
+    // SCHEDULING
+    void scheduleCompile(const File& file, int debounceMs, JobPriority priority, OptimisationTier tier = OptimisationTier::Fast);
+    int getScheduledCompileDelay(const File& file, OptimisationTier& tier);
+    void postponeOptimisations(); // scheduledCompilesMutex must be held
+    int postponeScheduledCompile(const File& file);
+    void scheduleOptimisation(const File& file);
+    StringArray getFileNamesBeingOptimised();
+    bool finishScheduledCompile(const File& file, bool abandoned = false);
+    void compilePendingEditsNow();
+    bool hasPendingEdits(); // scheduledCompilesMutex must be held
+    bool waitForPendingEdits(int timeoutMs);
+
+    // SYNTAX CHECKS
+    void scheduleSyntaxCheck(const File& file);
+    bool startSyntaxCheck(const File& file, uint32 generation, SyntaxCheckJob* job);
+    void finishSyntaxCheck(const File& file, SyntaxCheckJob* job);
+    CompilationStatus checkSyntax(CompileWorker& worker, const BuildSettings& settings, const File& file, const std::atomic<bool>& cancelled);
+    CompilationStatus parseForDiagnostics(CompileWorker& worker,
+                                          const File& file,
+                                          SourceBuffer::Ptr content,
+                                          std::unique_ptr<CompilerInvocation> compilerInvocation,
+                                          const File& preambleFile,
+                                          std::pair<unsigned, bool> preambleBounds,
+                                          const std::atomic<bool>& cancelled,
+                                          bool streamDiagnostics,
+                                          bool& usedPreamble);
+    File getPreamble(CompileWorker& worker,
+                     const BuildSettings& settings,
+                     const File& file,
+                     const SourceBuffer& content,
+                     unsigned preambleSize,
+                     const std::vector<std::string>& arguments);
+    bool buildPreamble(CompileWorker& worker,
+                       const BuildSettings& settings,
+                       const File& file,
+                       const SourceBuffer& content,
+                       unsigned preambleSize,
+                       const File& outputFile,
+                       SortedSet<String>& dependencies);
+    void remapLiveTexts(PreprocessorOptions& preprocessorOptions,
+                        const std::map<String, SourceBuffer::Ptr>& texts,
+                        std::vector<std::unique_ptr<llvm::MemoryBuffer>>& buffers);
+
+    // DOCUMENTS
+    LiveDocument::Ptr getDocument(const File& file);
+    void setDocumentText(const File& file, SourceBuffer::Ptr text);
+    SourceBuffer::Ptr getLiveText(const File& file);
+    std::map<String, SourceBuffer::Ptr> getLiveTexts();
+    void closeDocument(const File& file);
+
+    // HEADER DEPENDENCIES
+    static bool isHeaderFile(const File& file);
+    void updateDependencies(const File& file, const SortedSet<String>& includedFiles, bool persist = true);
+    bool getKnownDependencies(const File& file, SortedSet<String>& includedFiles);
+    void compileDependentsOf(const File& header);
+
+    // PRECOMPILED HEADER
+    void updatePrecompiledHeader(const File& changedFile = File());
+    void buildPrecompiledHeader(CompileWorker& worker, const BuildSettings& settings);
+    bool reusePrecompiledHeader();
+    bool loadPrecompiledHeaderDependencies(const File& pchFile, SortedSet<String>& dependencies) const;
+    bool isPrecompiledHeaderUpToDate(const File& pchFile, const SortedSet<String>& dependencies) const;
+    bool shouldUsePrecompiledHeader(const File& file);
+    File getPrecompiledHeader();
+    File getPrecompiledHeaderFile() const;
+
+    // CACHE
+    File getCacheBitCodeFile(const String& key) const;
+    File getCacheObjectFile(const String& key) const;
+    void cacheObject(const String& key);
+
+    String getCacheKey(const String& sourceHash,
+                       const std::vector<std::string>& arguments,
+                       const SortedSet<String>& includedFiles);
+    void updateManifest(const File& file,
+                        const String& sourceHash,
+                        const std::vector<std::string>& arguments,
+                        const String& key,
+                        OptimisationTier tier,
+                        uint32 compileMilliseconds);
+    bool loadCachedModule(const File& file,
+                          const String& sourceHash,
+                          const std::vector<std::string>& arguments,
+                          const String& key,
+                          OptimisationTier tier);
+    uint32 getLastCompileDuration(const File& file) const;
+
+    // The manifest and the file hashes are written a little after each build, and before every
+    // launch, the app runs in this process and a crash in it would lose the whole session
+    void scheduleIndexSave();
+    void saveIndex();
+
+    static const int indexSaveDelayMs = 2000;
+    std::atomic<bool> indexSavePending { false };
+    std::mutex indexSaveMutex;
+    static String getCompilerIdentity();
+
+    // CHANGE DETECTION
+    struct FileHash
+    {
+        int64 modificationTime;
+        int64 size;
+        uint64 identity;
+        String hash;
+    };
+
+    String getFileContentHash(const File& file);
+    static bool getFileStatus(const File& file, FileHash& status);
+    void loadFileHashes();
+    void saveFileHashes();
+
+    static const int fileHashesMagic = 0x48534831; // 'HSH1'
+
+    std::mutex hashesMutex;
+    std::map<String, FileHash> fileHashes;
+    bool fileHashesChanged = false;
 
     SendMessageFunction sendMessageFunction;
     void* callbackUserInfo;
     String juceProjectID;
     File juceCacheFolder;
+    BuildManifest manifest;
 
-    String systemPath;
-    String userPath;
-    StringArray defines;
-    StringArray extraCompilerFlags;
-    String extraDLLs;
-    String juceModulesFolder;
-    String utilsCppInclude;
     String clangIncludePath;
 
-    Array<File> compileUnits;
-    Array<File> userFiles;
+    // Swapped whole by setBuildInfo while the workers compile, never changed in place
+    BuildSettings::Ptr getBuildSettings();
+
+    std::mutex buildSettingsMutex;
+    BuildSettings::Ptr buildSettings;
+
+    // One compile job per file, edits arriving meanwhile push its start time, raise its priority
+    // while it waits in the queue or cancel the compile it is running
+    struct ScheduledCompile
+    {
+        uint32 startTime = 0;
+        bool isQueued = false;
+        bool isRunning = false;
+        bool isStale = false;
+        bool hasUserEdit = false;
+        bool runningUserEdit = false;
+        OptimisationTier tier = OptimisationTier::Optimised;
+        OptimisationTier runningTier = OptimisationTier::Fast;
+        CompileJob* job = nullptr;
+    };
+
+    // cc1 arguments the driver produced, keyed by build settings generation, language, tier,
+    // precompiled header and folder, the input is a placeholder substituted for each file,
+    // cleared by every setBuildInfo, only runs with the settings of the last one are kept
+    std::mutex argumentTemplatesMutex;
+    std::map<String, std::vector<std::string>> argumentTemplates;
+    uint32 argumentTemplatesGeneration = 0;
+    const std::string inputPathPlaceholder { "<input>" };
+    const std::string inputNamePlaceholder { "<input-name>" };
+
+    static const int editDebounceMs = 150;
+    static const int idleCompileDelayMs = 1000;
+    static const int optimisationBackoffMs = 2000;
+    static const int launchWaitTimeoutMs = 60000;
+    bool optimiseInBackground = true;
+
+    std::mutex scheduledCompilesMutex;
+    std::map<String, ScheduledCompile> scheduledCompiles;
+    std::condition_variable pendingEditsCondition;
+
+    // Keystrokes in a unit open in the editor only get it parsed for diagnostics, every change
+    // supersedes the check still queued and cancels the one running, codegen waits until idle
+    struct ScheduledSyntaxCheck
+    {
+        uint32 generation = 0;
+        SyntaxCheckJob* job = nullptr;
+    };
+
+    std::mutex syntaxChecksMutex;
+    std::map<String, ScheduledSyntaxCheck> syntaxChecks;
+    bool checkSyntaxWhileEditing = true;
+
+    // The includes at the top of each open unit precompiled on their own, the check skips over
+    // them and parses the rest of the text only, rebuilt when they or the headers they pull change
+    struct Preamble
+    {
+        String hash;
+        String key;
+        File file;
+        SortedSet<String> dependencies;
+    };
+
+    std::mutex preamblesMutex;
+    std::map<String, Preamble> preambles;
+
+    // the first check to find its preamble in use proves preambles work with this clang,
+    // one that finds it ignored turns them off for the rest of the session
+    std::atomic<bool> preamblesUsable { true };
+    std::atomic<bool> preamblesVerified { false };
+
+    // Files open in the editor, compiled from memory in place of the files on disk
+    std::mutex documentsMutex;
+    std::map<String, LiveDocument::Ptr> documents;
+
+    std::mutex dependenciesMutex;
+    std::map<String, SortedSet<String>> includesByUnit;
+    std::map<String, SortedSet<String>> unitsByHeader;
+
+    // juceHeaderFile is written by setBuildInfo and read by the workers, both under precompiledHeaderMutex
+    std::mutex precompiledHeaderMutex;
+    File juceHeaderFile;
+    String precompiledHeaderKey;
+    File precompiledHeader;
+    SortedSet<String> precompiledHeaderDependencies;
+    bool precompiledHeaderBuilding = false;
+
+    // STATISTICS
+    struct Statistics
+    {
+        std::atomic<int> compilesStarted { 0 };
+        std::atomic<int> compilesSucceeded { 0 };
+        std::atomic<int> compilesFailed { 0 };
+        std::atomic<int> compilesCancelled { 0 };
+        std::atomic<int> cacheHits { 0 };
+        std::atomic<int> syntaxChecks { 0 };
+        std::atomic<int> preamblesBuilt { 0 };
+        std::atomic<int> syntaxCheckMilliseconds { 0 };
+        std::atomic<int> objectsGenerated { 0 };
+        std::atomic<int> objectsLoaded { 0 };
+        std::atomic<int> objectsCached { 0 };
+        std::atomic<int> unitsLaunchedLazily { 0 };
+    };
+
+    Statistics statistics;
 
-    ThreadPool activitiesPool;
     SharedQueue<MessageEvents> messageQueue;
 
+    // OUTBOUND MESSAGES
+    // Activity lists go out at most once per frame and only when they changed
+    static const int activityListIntervalMs = 33;
+    std::atomic<bool> activityListPending { false };
+    uint32 lastActivityListTime = 0;
+    StringArray lastActivityList;
+    bool hasSentActivityList = false;
+
+    void updateActivityList();
+
+    // DIAGNOSTICS
+    // The list of each unit keyed by its canonical path, the Projucer replaces its whole list on every
+    // DIAGNOSTIC_LIST so all of them go out merged, at most once per frame like the activity list
+    void setDiagnostics(const File& unit, const ValueTree& list);
+    void appendDiagnostic(const String& unitPath, const ValueTree& diagnostic, bool isNote, bool replacesList);
+    void sendDiagnosticListUpdate();
+    void updateDiagnosticList();
+
+    std::mutex diagnosticsMutex;
+    std::map<String, ValueTree> diagnosticsByUnit;
+    std::atomic<bool> diagnosticListPending { false };
+    uint32 lastDiagnosticListTime = 0;
+
+    // Serialised messages reuse one buffer, which also keeps calls to the Projucer in order
+    std::mutex sendMutex;
+    MemoryOutputStream sendBuffer;
+
+    // WORKERS
+    CompileWorker* acquireWorker();
+    void releaseWorker(CompileWorker* worker);
+
+    std::mutex workersMutex;
+    std::vector<std::unique_ptr<CompileWorker>> workers;
+    Array<CompileWorker*> idleWorkers;
+
     // CLANG
-    ModulePtr compileFile(const File& file);
-    std::unique_ptr<CompilerInvocation> createCompilerInvocation(const File& file);
-    std::unique_ptr<CodeGenAction> generateCode(const File& file);
-    std::unique_ptr<llvm::ExecutionEngine> createExecutionEngine(ModulePtr module, std::string* errorString);
+    ModulePtr compileFile(CompileWorker& worker,
+                          std::unique_ptr<CompilerInvocation> compilerInvocation,
+                          const std::atomic<bool>& cancelled,
+                          SortedSet<String>& includedFiles);
+    std::unique_ptr<CompilerInvocation> createCompilerInvocation(CompileWorker& worker,
+                                                                 const BuildSettings& settings,
+                                                                 const File& file,
+                                                                 const File& precompiledHeaderFile,
+                                                                 OptimisationTier tier,
+                                                                 std::vector<std::string>& arguments);
+    bool getCompilerArguments(CompileWorker& worker,
+                              const BuildSettings& settings,
+                              const File& file,
+                              const File& precompiledHeaderFile,
+                              OptimisationTier tier,
+                              std::vector<std::string>& arguments);
+    bool runCompilerDriver(CompileWorker& worker,
+                           const BuildSettings& settings,
+                           const File& file,
+                           const File& precompiledHeaderFile,
+                           OptimisationTier tier,
+                           std::vector<std::string>& arguments);
+    std::unique_ptr<CodeGenAction> generateCode(CompileWorker& worker,
+                                                std::unique_ptr<CompilerInvocation> compilerInvocation,
+                                                const std::atomic<bool>& cancelled,
+                                                SortedSet<String>& includedFiles);
+
+    ModulePtr loadModuleIntoLinkingContext(llvm::MemoryBufferRef bitcode);
+    static std::unique_ptr<llvm::MemoryBuffer> mapBitcodeFile(const File& bitcodeFile);
+    ModulePtr readLazyModule(std::unique_ptr<llvm::MemoryBuffer> bitcode); // contextMutex must be held
+    ModulePtr loadLazyModule(const File& bitcodeFile);
+
+    // MODULES
+    struct LoadedModule
+    {
+        String key;
+        ModulePtr module;
+        OptimisationTier tier = OptimisationTier::Fast;
+        bool isVerified = true;
+        size_t bitcodeSize = 0;
+        int numFunctions = 0;
+        int numGlobals = 0;
+        int64 numInstructions = 0;
+    };
+
+    void addModule(const File& file, const String& key, ModulePtr module, size_t bitcodeSize,
+                   OptimisationTier tier, bool isVerified = true);
+    bool isModuleLoaded(const File& file, const String& key);
+    bool isModuleLoaded(const File& file);
+    bool isModuleOptimised(const File& file);
+    void evictRemovedModules(const BuildSettings& settings);
+    void clearModules();
+
+    // Warm start, the units loaded at the end of the last session are mapped again before
+    // BUILDINFO arrives, the first compile check of each unit confirms or replaces them
+    void prefetchModules();
+    void prefetchModule(const File& file, const String& key, OptimisationTier tier);
 
     llvm::llvm_shutdown_obj shutdownObject;
-    IntrusiveRefCntPtr<DiagnosticOptions> diagOpts;
-    DiagnosticReporter* diagClient;
-    IntrusiveRefCntPtr<DiagnosticIDs> diagIdentifier;
-    DiagnosticsEngine diagEngine;
-    std::unique_ptr<Driver> compilerDriver;
-    std::unique_ptr<CompilerInstance> compilerInstance;
+    std::string targetTriple;
+
+    // Modules handed over by the workers all live in this context so they can be linked together
+    std::mutex contextMutex;
     std::unique_ptr<llvm::LLVMContext> context;
+
+    // One module per compile unit keyed by its canonical path, a recompile replaces it in place.
+    // Modules belong to the linking context, they are only destroyed while holding contextMutex
     std::mutex modulesMutex;
-    ModulePtrList modules;
+    std::unordered_map<String, LoadedModule, StringHash> modules;
+
+    // The canonical paths of compileUnits as of the last BUILDINFO, under modulesMutex for the prefetch jobs
+    std::unordered_map<String, bool, StringHash> projectUnitPaths;
+    bool hasProjectUnits = false;
+
+    // Machine code of the units, kept from one launch to the next, or generated on first call when lazy
+    std::unique_ptr<LiveJIT> liveJIT;
+    bool lazyLaunch = true;
+    bool precompileHotFunctions = true;
+
+    // JOBS
+    // Declared last so it goes first, its threads are joined before the members its jobs use are destroyed
+    JobScheduler activitiesPool;
 };
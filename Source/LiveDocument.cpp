@@ -0,0 +1,230 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#include "LiveDocument.h"
+
+//==============================================================================
+static int countCharacters(const char* data, size_t numBytes)
+{
+    return (int) CharPointer_UTF8(data).lengthUpTo(CharPointer_UTF8(data + numBytes));
+}
+
+static size_t getByteOffset(const char* data, size_t numBytes, int numChars, int charIndex)
+{
+    // plain ascii pieces map characters to bytes one to one
+    if ((size_t) numChars == numBytes)
+        return (size_t) charIndex;
+
+    CharPointer_UTF8 p(data);
+    p += charIndex;
+    return (size_t) (p.getAddress() - data);
+}
+
+//==============================================================================
+SourceBuffer::SourceBuffer(const void* sourceData, size_t sourceSize)
+    : data(sourceSize + 1),
+      size(sourceSize)
+{
+    memcpy(data, sourceData, sourceSize);
+    data[sourceSize] = 0;
+}
+
+SourceBuffer::SourceBuffer(const String& text)
+    : SourceBuffer(text.toRawUTF8(), text.getNumBytesAsUTF8())
+{
+}
+
+String SourceBuffer::toString() const
+{
+    return String::fromUTF8(data, (int) size);
+}
+
+String SourceBuffer::getHash() const
+{
+    std::lock_guard<std::mutex> lock(hashMutex);
+
+    if (hash.isEmpty())
+        hash = FastHash::toHexString(data, size);
+
+    return hash;
+}
+
+//==============================================================================
+LiveDocument::LiveDocument(SourceBuffer::Ptr text)
+{
+    setText(text);
+}
+
+void LiveDocument::setText(SourceBuffer::Ptr text)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    original = text;
+    added.clear();
+    pieces.clear();
+
+    numChars = countCharacters(original->getData(), original->getSize());
+    if (original->getSize() > 0)
+        pieces.push_back({ false, 0, original->getSize(), numChars });
+
+    ++version;
+}
+
+void LiveDocument::applyChanges(const Array<LiveCodeChange>& changes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto& change : changes)
+        replace(change.start, change.end, change.text, change.numBytes);
+
+    ++version;
+
+    // long editing sessions leave lots of tiny pieces behind, start over from a flat copy
+    if (pieces.size() > 4096)
+    {
+        MemoryOutputStream out;
+        for (auto& piece : pieces)
+            out.write(getPieceData(piece), piece.numBytes);
+
+        original = new SourceBuffer(out.getData(), out.getDataSize());
+        added.clear();
+        pieces.clear();
+
+        if (original->getSize() > 0)
+            pieces.push_back({ false, 0, original->getSize(), numChars });
+    }
+}
+
+SourceBuffer::Ptr LiveDocument::getSnapshot()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (snapshot == nullptr || snapshotVersion != version)
+    {
+        if (pieces.size() == 1 && ! pieces[0].isAdded && pieces[0].numBytes == original->getSize())
+        {
+            snapshot = original;
+        }
+        else
+        {
+            MemoryOutputStream out;
+            for (auto& piece : pieces)
+                out.write(getPieceData(piece), piece.numBytes);
+
+            snapshot = new SourceBuffer(out.getData(), out.getDataSize());
+        }
+
+        snapshotVersion = version;
+    }
+
+    return snapshot;
+}
+
+uint32 LiveDocument::getVersion() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return version;
+}
+
+//==============================================================================
+void LiveDocument::replace(int startChar, int endChar, const char* text, size_t numBytes)
+{
+    startChar = jlimit(0, numChars, startChar);
+    endChar = jlimit(startChar, numChars, endChar);
+
+    const size_t first = splitAt(startChar);
+    const size_t last = splitAt(endChar);
+
+    pieces.erase(pieces.begin() + (std::ptrdiff_t) first, pieces.begin() + (std::ptrdiff_t) last);
+    numChars -= endChar - startChar;
+
+    if (numBytes == 0)
+        return;
+
+    const int textChars = countCharacters(text, numBytes);
+
+    // typing appends to the piece inserted by the previous keystroke
+    if (first > 0)
+    {
+        Piece& previous = pieces[first - 1];
+        if (previous.isAdded && previous.start + previous.numBytes == added.size())
+        {
+            added.append(text, numBytes);
+            previous.numBytes += numBytes;
+            previous.numChars += textChars;
+            numChars += textChars;
+            return;
+        }
+    }
+
+    pieces.insert(pieces.begin() + (std::ptrdiff_t) first, { true, added.size(), numBytes, textChars });
+    added.append(text, numBytes);
+    numChars += textChars;
+}
+
+size_t LiveDocument::splitAt(int charIndex)
+{
+    int pieceStart = 0;
+
+    for (size_t i = 0; i < pieces.size(); i++)
+    {
+        Piece& piece = pieces[i];
+
+        if (charIndex == pieceStart)
+            return i;
+
+        if (charIndex < pieceStart + piece.numChars)
+        {
+            const int headChars = charIndex - pieceStart;
+            const size_t headBytes = getByteOffset(getPieceData(piece), piece.numBytes, piece.numChars, headChars);
+
+            const Piece tail = { piece.isAdded, piece.start + headBytes, piece.numBytes - headBytes, piece.numChars - headChars };
+            piece.numBytes = headBytes;
+            piece.numChars = headChars;
+
+            pieces.insert(pieces.begin() + (std::ptrdiff_t) i + 1, tail);
+            return i + 1;
+        }
+
+        pieceStart += piece.numChars;
+    }
+
+    return pieces.size();
+}
+
+const char* LiveDocument::getPieceData(const Piece& piece) const noexcept
+{
+    return (piece.isAdded ? added.data() : original->getData()) + piece.start;
+}
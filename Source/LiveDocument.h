@@ -0,0 +1,136 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "Common.h"
+#include "Hashing.h"
+
+#include <vector>
+
+//==============================================================================
+/** An edit as sent by the Projucer, the text points into the message it came
+    with and is only valid while the message is being handled. */
+struct LiveCodeChange
+{
+    int start;
+    int end;
+    const char* text;
+    size_t numBytes;
+};
+
+//==============================================================================
+/** Immutable UTF-8 text shared between the document store and the compiler.
+
+    The data is always null terminated, so it can be handed to clang as a
+    memory buffer without copying it.
+*/
+class SourceBuffer : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<SourceBuffer> Ptr;
+
+    SourceBuffer(const void* data, size_t size);
+    explicit SourceBuffer(const String& text);
+
+    const char* getData() const noexcept { return data; }
+    size_t getSize() const noexcept { return size; }
+
+    String toString() const;
+
+    /** Content hash, computed on first use and then remembered. */
+    String getHash() const;
+
+private:
+    HeapBlock<char> data;
+    size_t size;
+
+    mutable std::mutex hashMutex;
+    mutable String hash;
+
+    JUCE_DECLARE_NON_COPYABLE(SourceBuffer)
+};
+
+//==============================================================================
+/** The text of a file open in the editor, kept as a piece table.
+
+    Changes coming from Projucer are applied incrementally against the text
+    left by the previous edit, without touching the file on disk. The text is
+    only flattened when someone asks for a snapshot, and then at most once per
+    version.
+*/
+class LiveDocument : public ReferenceCountedObject
+{
+public:
+    typedef ReferenceCountedObjectPtr<LiveDocument> Ptr;
+
+    explicit LiveDocument(SourceBuffer::Ptr text);
+
+    /** Replaces the whole text, dropping every edit applied so far. */
+    void setText(SourceBuffer::Ptr text);
+
+    /** Applies a batch of changes, each one relative to the text left by the previous one. */
+    void applyChanges(const Array<LiveCodeChange>& changes);
+
+    /** Returns the current text. */
+    SourceBuffer::Ptr getSnapshot();
+
+    /** Increases every time the text changes. */
+    uint32 getVersion() const;
+
+private:
+    struct Piece
+    {
+        bool isAdded;
+        size_t start;
+        size_t numBytes;
+        int numChars;
+    };
+
+    void replace(int startChar, int endChar, const char* text, size_t numBytes);
+    size_t splitAt(int charIndex);
+    const char* getPieceData(const Piece& piece) const noexcept;
+
+    mutable std::mutex mutex;
+    SourceBuffer::Ptr original;
+    std::string added;
+    std::vector<Piece> pieces;
+    int numChars = 0;
+    uint32 version = 0;
+
+    SourceBuffer::Ptr snapshot;
+    uint32 snapshotVersion = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(LiveDocument)
+};
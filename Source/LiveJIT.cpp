@@ -0,0 +1,519 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#include "LiveJIT.h"
+#include "Hashing.h"
+
+#include <algorithm>
+
+//==============================================================================
+static llvm::TargetMachine* createHostTargetMachine(const std::string& targetTriple)
+{
+    // code generated for the cpu it runs on, the cache key tells hosts apart
+    llvm::SmallVector<std::string, 32> attributes;
+
+    llvm::StringMap<bool> features;
+    if (llvm::sys::getHostCPUFeatures(features))
+        for (auto& feature : features)
+            attributes.push_back((feature.second ? "+" : "-") + feature.first().str());
+
+    std::sort(attributes.begin(), attributes.end());
+
+    return llvm::EngineBuilder().selectTarget(llvm::Triple(targetTriple), "", llvm::sys::getHostCPUName(), attributes);
+}
+
+//==============================================================================
+LiveJIT::LiveJIT(const std::string& targetTriple)
+    : targetMachine(createHostTargetMachine(targetTriple)),
+      dataLayout(targetMachine->createDataLayout()),
+      runtimeOverrides([this] (const std::string& name) { return mangle(name); }),
+      compileLayer(objectLayer, llvm::orc::SimpleCompiler(*targetMachine)),
+      compileCallbackManager(llvm::orc::createLocalCompileCallbackManager(targetMachine->getTargetTriple(), 0)),
+      lazyLayer(compileLayer,
+                [this] (llvm::Function& function) { return partition(function); },
+                *compileCallbackManager,
+                llvm::orc::createLocalIndirectStubsManagerBuilder(targetMachine->getTargetTriple()))
+{
+    String targetDescription;
+    targetDescription << targetMachine->getTargetTriple().str() << " "
+                      << targetMachine->getTargetCPU().str() << " "
+                      << targetMachine->getTargetFeatureString().str() << " "
+                      << "O" << (int) targetMachine->getOptLevel();
+
+    targetKey = FastHash::toHexString(targetDescription.toRawUTF8(), targetDescription.getNumBytesAsUTF8()).substring(0, 16);
+
+    // symbols of the host process, the juce and system libraries, are resolved from here
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+}
+
+LiveJIT::~LiveJIT()
+{
+    unlink();
+}
+
+//==============================================================================
+bool LiveJIT::isUpToDate(const String& unitPath, const String& key) const
+{
+    auto it = units.find(unitPath);
+    return it != units.end() && it->second.key == key;
+}
+
+bool LiveJIT::compileModule(const String& unitPath, const String& key, llvm::Module& module, const File& objectFile)
+{
+    CompiledUnit unit;
+    unit.key = key;
+
+    // named after the module, so the names are the same in the object loaded from the cache
+    exposeStaticConstructors(module, getStaticConstructorsPrefix(key), unit.constructors, unit.destructors);
+    module.setDataLayout(dataLayout);
+
+    unit.objectData = generateObject(module, objectFile);
+    if (unit.objectData == nullptr)
+        return false;
+
+    // the next launch loads the object without going through the module for these names
+    if (objectFile != File())
+        saveStaticConstructors(objectFile, unit.constructors, unit.destructors);
+
+    return addUnit(unitPath, std::move(unit), objectFile);
+}
+
+bool LiveJIT::cacheObject(const String& key, llvm::Module& module, const File& objectFile) const
+{
+    std::vector<std::string> constructors;
+    std::vector<std::string> destructors;
+    if (loadStaticConstructors(objectFile, constructors, destructors))
+        return true;
+
+    exposeStaticConstructors(module, getStaticConstructorsPrefix(key), constructors, destructors);
+    module.setDataLayout(dataLayout);
+
+    // the target machine of the session is only used by the thread launching the app
+    std::unique_ptr<llvm::TargetMachine> machine(createHostTargetMachine(targetMachine->getTargetTriple().str()));
+    if (machine == nullptr)
+        return false;
+
+    auto binary = llvm::orc::SimpleCompiler(*machine)(module).takeBinary();
+    if (binary.second == nullptr)
+        return false;
+
+    // the names go last, they are what tells a launch the object is there
+    objectFile.getParentDirectory().createDirectory();
+    if (! objectFile.replaceWithData(binary.second->getBufferStart(), binary.second->getBufferSize()))
+        return false;
+
+    saveStaticConstructors(objectFile, constructors, destructors);
+    return true;
+}
+
+bool LiveJIT::loadObject(const String& unitPath, const String& key, const File& objectFile)
+{
+    CompiledUnit unit;
+    unit.key = key;
+
+    if (! loadStaticConstructors(objectFile, unit.constructors, unit.destructors))
+        return false;
+
+    auto cached = llvm::MemoryBuffer::getFile(objectFile.getFullPathName().toRawUTF8());
+    if (! cached)
+        return false;
+
+    unit.objectData = std::move(cached.get());
+    return addUnit(unitPath, std::move(unit), objectFile);
+}
+
+bool LiveJIT::addUnit(const String& unitPath, CompiledUnit unit, const File& objectFile)
+{
+    auto object = llvm::object::ObjectFile::createObjectFile(unit.objectData->getMemBufferRef());
+    if (! object)
+    {
+        llvm::consumeError(object.takeError());
+
+        // a damaged entry is generated again on the next launch
+        objectFile.deleteFile();
+        getStaticConstructorsFile(objectFile).deleteFile();
+        return false;
+    }
+
+    unit.object = std::move(object.get());
+
+    units[unitPath] = std::move(unit);
+    return true;
+}
+
+void LiveJIT::retainUnits(const StringArray& unitPaths)
+{
+    for (auto it = units.begin(); it != units.end();)
+    {
+        if (unitPaths.contains(it->first))
+            ++it;
+        else
+            it = units.erase(it);
+    }
+}
+
+//==============================================================================
+int LiveJIT::runMain(const Array<File>& lazyBitcodeFiles, const std::vector<std::string>& arguments, String& errorString)
+{
+    // the image of the previous launch still points at replaced objects
+    unlink();
+
+    modulesWithHotFunctionsCompiled.clear();
+    reachedFunctions.clear();
+
+    std::vector<std::string> constructorNames;
+    std::vector<std::string> destructorNames;
+
+    if (! lazyBitcodeFiles.isEmpty())
+    {
+        // a context per launch, the modules and everything they created go away with it
+        lazyContext = llvm::make_unique<llvm::LLVMContext>();
+
+        std::vector<std::unique_ptr<llvm::Module>> modules;
+        for (auto& bitcodeFile : lazyBitcodeFiles)
+        {
+            llvm::SMDiagnostic diag;
+            std::unique_ptr<llvm::Module> module(llvm::parseIRFile(bitcodeFile.getFullPathName().toRawUTF8(), diag, *lazyContext));
+            if (! module)
+            {
+                errorString = "Unable to load bitcode " + bitcodeFile.getFullPathName();
+                return -1;
+            }
+
+            module->setDataLayout(dataLayout);
+            exposeStaticConstructors(*module, "__live_lazy" + std::to_string(nextLazyUnitId++), constructorNames, destructorNames);
+
+            modules.push_back(std::move(module));
+        }
+
+        // functions resolve to the objects or to the stubs of other units, the rest comes from the host process
+        auto resolver = llvm::orc::createLambdaResolver(
+            [this] (const std::string& name) {
+                if (isLinked)
+                    if (auto symbol = objectLayer.findSymbolIn(linkedObjects, name, false))
+                        return symbol.toRuntimeDyldSymbol();
+
+                if (auto symbol = lazyLayer.findSymbol(name, false))
+                    return symbol.toRuntimeDyldSymbol();
+
+                return llvm::RuntimeDyld::SymbolInfo(nullptr);
+            },
+            [this] (const std::string& name) {
+                return findHostSymbol(name);
+            });
+
+        lazyModules = lazyLayer.addModuleSet(std::move(modules),
+                                             llvm::make_unique<llvm::SectionMemoryManager>(),
+                                             std::move(resolver));
+        isLazilyLinked = true;
+    }
+
+    std::vector<llvm::object::ObjectFile*> objects;
+    for (auto& entry : units)
+    {
+        objects.push_back(entry.second.object.get());
+        constructorNames.insert(constructorNames.end(), entry.second.constructors.begin(), entry.second.constructors.end());
+        destructorNames.insert(destructorNames.end(), entry.second.destructors.begin(), entry.second.destructors.end());
+    }
+
+    if (! objects.empty())
+    {
+        // symbols between objects resolve inside the set, then come the stubs of the lazy units and the host process
+        auto resolver = llvm::orc::createLambdaResolver(
+            [this] (const std::string& name) {
+                if (isLazilyLinked)
+                    if (auto symbol = lazyLayer.findSymbol(name, false))
+                        return symbol.toRuntimeDyldSymbol();
+
+                return llvm::RuntimeDyld::SymbolInfo(nullptr);
+            },
+            [this] (const std::string& name) {
+                return findHostSymbol(name);
+            });
+
+        linkedObjects = objectLayer.addObjectSet(std::move(objects),
+                                                 llvm::make_unique<llvm::SectionMemoryManager>(),
+                                                 std::move(resolver));
+        isLinked = true;
+
+        objectLayer.emitAndFinalize(linkedObjects);
+    }
+
+    auto mainSymbol = findSymbolToRun(mangle("main"));
+    if (! mainSymbol)
+    {
+        errorString = "'main' function not found in module";
+        return -1;
+    }
+
+    typedef void (*VoidFunction) ();
+    typedef int (*MainFunction) (int, char**);
+
+    for (auto& name : constructorNames)
+        if (auto symbol = findSymbolToRun(name))
+            reinterpret_cast<VoidFunction>(static_cast<uintptr_t>(symbol.getAddress()))();
+
+    std::vector<char*> argv;
+    for (auto& argument : arguments)
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    argv.push_back(nullptr);
+
+    const int result = reinterpret_cast<MainFunction>(static_cast<uintptr_t>(mainSymbol.getAddress()))((int) arguments.size(), argv.data());
+
+    for (auto& name : destructorNames)
+        if (auto symbol = findSymbolToRun(name))
+            reinterpret_cast<VoidFunction>(static_cast<uintptr_t>(symbol.getAddress()))();
+
+    runtimeOverrides.runDestructors();
+
+    if (isLazilyLinked)
+        saveHotFunctions();
+
+    return result;
+}
+
+void LiveJIT::setHotFunctionsFile(const File& file)
+{
+    hotFunctionsFile = file;
+    loadHotFunctions();
+}
+
+//==============================================================================
+std::string LiveJIT::mangle(const std::string& name) const
+{
+    std::string mangledName;
+    llvm::raw_string_ostream stream(mangledName);
+    llvm::Mangler::getNameWithPrefix(stream, name, dataLayout);
+    return stream.str();
+}
+
+void LiveJIT::exposeStaticConstructors(llvm::Module& module,
+                                       const std::string& prefix,
+                                       std::vector<std::string>& constructors,
+                                       std::vector<std::string>& destructors) const
+{
+    // static constructors have internal linkage, once exported under a name unique
+    // to this unit they can be looked up and run after linking
+    int index = 0;
+    for (auto constructor : llvm::orc::getConstructors(module))
+        if (constructor.Func != nullptr)
+            constructors.push_back(exposeFunction(module, constructor.Func, prefix + "_ctor" + std::to_string(index++)));
+
+    index = 0;
+    for (auto destructor : llvm::orc::getDestructors(module))
+        if (destructor.Func != nullptr)
+            destructors.push_back(exposeFunction(module, destructor.Func, prefix + "_dtor" + std::to_string(index++)));
+}
+
+std::string LiveJIT::getStaticConstructorsPrefix(const String& key)
+{
+    return "__live_" + key.substring(0, 16).toStdString();
+}
+
+File LiveJIT::getStaticConstructorsFile(const File& objectFile)
+{
+    return objectFile.withFileExtension(".ctors");
+}
+
+void LiveJIT::saveStaticConstructors(const File& objectFile,
+                                     const std::vector<std::string>& constructors,
+                                     const std::vector<std::string>& destructors)
+{
+    const File file(getStaticConstructorsFile(objectFile));
+    if (file.existsAsFile())
+        return;
+
+    // one name per line, constructors marked with c and destructors with d
+    String text("names\n");
+    for (auto& name : constructors)
+        text << "c " << String::fromUTF8(name.c_str()) << "\n";
+    for (auto& name : destructors)
+        text << "d " << String::fromUTF8(name.c_str()) << "\n";
+
+    file.replaceWithText(text);
+}
+
+bool LiveJIT::loadStaticConstructors(const File& objectFile,
+                                     std::vector<std::string>& constructors,
+                                     std::vector<std::string>& destructors)
+{
+    const File file(getStaticConstructorsFile(objectFile));
+    if (! objectFile.existsAsFile() || ! file.existsAsFile())
+        return false;
+
+    StringArray lines;
+    file.readLines(lines);
+
+    // the first line tells a complete file from one cut short, a unit without constructors has nothing else
+    if (lines.size() == 0 || lines[0] != "names")
+        return false;
+
+    for (int i = 1; i < lines.size(); i++)
+    {
+        const String& line = lines.getReference(i);
+        if (line.startsWith("c "))
+            constructors.push_back(line.substring(2).toStdString());
+        else if (line.startsWith("d "))
+            destructors.push_back(line.substring(2).toStdString());
+    }
+
+    return true;
+}
+
+std::string LiveJIT::exposeFunction(llvm::Module& module, const llvm::Function* function, const std::string& newName) const
+{
+    llvm::Function* exposed = module.getFunction(function->getName());
+    exposed->setName(newName);
+    exposed->setLinkage(llvm::GlobalValue::ExternalLinkage);
+
+    return mangle(exposed->getName().str());
+}
+
+std::unique_ptr<llvm::MemoryBuffer> LiveJIT::generateObject(llvm::Module& module, const File& objectFile)
+{
+    if (objectFile.existsAsFile())
+    {
+        auto cached = llvm::MemoryBuffer::getFile(objectFile.getFullPathName().toRawUTF8());
+        if (cached)
+            return std::move(cached.get());
+    }
+
+    auto binary = llvm::orc::SimpleCompiler(*targetMachine)(module).takeBinary();
+    if (binary.second == nullptr)
+        return nullptr;
+
+    // entries are immutable, written aside and moved in place
+    if (objectFile != File())
+    {
+        objectFile.getParentDirectory().createDirectory();
+        objectFile.replaceWithData(binary.second->getBufferStart(), binary.second->getBufferSize());
+    }
+
+    return std::move(binary.second);
+}
+
+llvm::RuntimeDyld::SymbolInfo LiveJIT::findHostSymbol(const std::string& name)
+{
+    llvm::RuntimeDyld::SymbolInfo symbol(runtimeOverrides.searchOverrides(name));
+    if (symbol.getAddress() != 0)
+        return symbol;
+
+    if (auto address = llvm::RTDyldMemoryManager::getSymbolAddressInProcess(name))
+        return llvm::RuntimeDyld::SymbolInfo(address, llvm::JITSymbolFlags::Exported);
+
+    return llvm::RuntimeDyld::SymbolInfo(nullptr);
+}
+
+llvm::orc::JITSymbol LiveJIT::findSymbolToRun(const std::string& name)
+{
+    if (isLinked)
+        if (auto symbol = objectLayer.findSymbolIn(linkedObjects, name, false))
+            return symbol;
+
+    if (isLazilyLinked)
+        return lazyLayer.findSymbolIn(lazyModules, name, false);
+
+    return llvm::orc::JITSymbol(nullptr);
+}
+
+//==============================================================================
+std::set<llvm::Function*> LiveJIT::partition(llvm::Function& function)
+{
+    std::set<llvm::Function*> functions;
+    functions.insert(&function);
+
+    // the first call into a unit generates the functions earlier launches reached along with it,
+    // ORC is not thread safe in this LLVM, so this is as far ahead as they can be compiled
+    const llvm::Module* module = function.getParent();
+    if (! hotFunctions.empty() && modulesWithHotFunctionsCompiled.insert(module).second)
+    {
+        for (llvm::Function& candidate : *function.getParent())
+            if (! candidate.isDeclaration() && hotFunctions.count(candidate.getName().str()) > 0)
+                functions.insert(&candidate);
+    }
+
+    // hot functions generated ahead never come through here on their own, they are
+    // recorded with the one that was called or they would drop out of the next save
+    for (llvm::Function* emitted : functions)
+        reachedFunctions.insert(emitted->getName().str());
+
+    return functions;
+}
+
+void LiveJIT::loadHotFunctions()
+{
+    hotFunctions.clear();
+
+    if (! hotFunctionsFile.existsAsFile())
+        return;
+
+    StringArray lines;
+    hotFunctionsFile.readLines(lines);
+    for (auto& line : lines)
+        if (line.isNotEmpty())
+            hotFunctions.insert(line.toStdString());
+}
+
+void LiveJIT::saveHotFunctions()
+{
+    if (hotFunctionsFile == File() || reachedFunctions.empty())
+        return;
+
+    hotFunctions = reachedFunctions;
+
+    String text;
+    for (auto& name : hotFunctions)
+        text << String::fromUTF8(name.c_str()) << "\n";
+
+    hotFunctionsFile.getParentDirectory().createDirectory();
+    hotFunctionsFile.replaceWithText(text);
+}
+
+void LiveJIT::unlink()
+{
+    if (isLinked)
+    {
+        objectLayer.removeObjectSet(linkedObjects);
+        isLinked = false;
+    }
+
+    // the modules of the lazy layer live in its context, they go first
+    if (isLazilyLinked)
+    {
+        lazyLayer.removeModuleSet(lazyModules);
+        isLazilyLinked = false;
+    }
+
+    lazyContext.reset();
+}
@@ -0,0 +1,185 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "Common.h"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/IndirectionUtils.h"
+#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
+#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Mangler.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <set>
+#include <vector>
+
+//==============================================================================
+/** JIT session that lives as long as the builder and keeps machine code per compile unit.
+
+    Only units whose module changed since the last launch go through code generation,
+    the others reuse their object. Every launch links all objects into a fresh image,
+    so symbols always resolve to the current definitions across units and the globals
+    of the app start from their initial values, as they would in a new process.
+
+    Objects are also kept on disk, keyed by the module and the target they were generated
+    for, so a unit whose object is in the cache never goes through code generation again.
+
+    Units launched lazily go through no code generation up front: every function
+    starts as a stub that compiles its body on the first call, so the launch only pays
+    for the code main actually reaches. Functions called during earlier lazy launches
+    are remembered as hot and generated together with the first function of their unit.
+    Their objects are generated in the background meanwhile, for the next launch to load.
+*/
+class LiveJIT
+{
+public:
+    /** The triple must be the one the modules were compiled for. */
+    explicit LiveJIT(const std::string& targetTriple);
+    ~LiveJIT();
+
+    /** True when the object of the unit was generated from the module with this key. */
+    bool isUpToDate(const String& unitPath, const String& key) const;
+
+    /** Identifies the machine code this JIT generates: triple, cpu, features and optimisation level. */
+    const String& getTargetKey() const noexcept { return targetKey; }
+
+    /** Loads the object of a unit from the cache file, or generates and stores it there,
+        replacing the previous object of the unit.
+
+        The module gets its static constructors renamed, so pass a copy, and the
+        caller must hold the lock of its LLVMContext.
+    */
+    bool compileModule(const String& unitPath, const String& key, llvm::Module& module, const File& objectFile);
+
+    /** Generates the object of a unit into the cache file for a later launch to load, without
+        adding it to this session. It uses a target machine of its own so it can run on any thread,
+        the module is changed as by compileModule and must belong to a context of that thread.
+    */
+    bool cacheObject(const String& key, llvm::Module& module, const File& objectFile) const;
+
+    /** Takes the object of a unit straight from the cache file, without its module.
+        False when the object or the names of its static constructors aren't in the cache.
+    */
+    bool loadObject(const String& unitPath, const String& key, const File& objectFile);
+
+    /** Forgets the objects of units that are not part of the project anymore. */
+    void retainUnits(const StringArray& unitPaths);
+
+    /** Links the current objects together with the units given as bitcode, which are compiled
+        function by function on first call, then runs the static constructors, main and the destructors.
+    */
+    int runMain(const Array<File>& lazyBitcodeFiles, const std::vector<std::string>& arguments, String& errorString);
+
+    /** Where the functions reached by lazy launches are remembered, leave empty to not precompile any. */
+    void setHotFunctionsFile(const File& file);
+
+private:
+    typedef llvm::orc::ObjectLinkingLayer<> ObjectLayer;
+    typedef llvm::orc::IRCompileLayer<ObjectLayer> CompileLayer;
+    typedef llvm::orc::CompileOnDemandLayer<CompileLayer> LazyLayer;
+
+    struct CompiledUnit
+    {
+        String key;
+        std::unique_ptr<llvm::object::ObjectFile> object;
+        std::unique_ptr<llvm::MemoryBuffer> objectData;
+        std::vector<std::string> constructors;
+        std::vector<std::string> destructors;
+    };
+
+    std::string mangle(const std::string& name) const;
+    void exposeStaticConstructors(llvm::Module& module,
+                                  const std::string& prefix,
+                                  std::vector<std::string>& constructors,
+                                  std::vector<std::string>& destructors) const;
+    static std::string getStaticConstructorsPrefix(const String& key);
+    std::unique_ptr<llvm::MemoryBuffer> generateObject(llvm::Module& module, const File& objectFile);
+    bool addUnit(const String& unitPath, CompiledUnit unit, const File& objectFile);
+    static File getStaticConstructorsFile(const File& objectFile);
+    static void saveStaticConstructors(const File& objectFile,
+                                       const std::vector<std::string>& constructors,
+                                       const std::vector<std::string>& destructors);
+    static bool loadStaticConstructors(const File& objectFile,
+                                       std::vector<std::string>& constructors,
+                                       std::vector<std::string>& destructors);
+    std::string exposeFunction(llvm::Module& module, const llvm::Function* function, const std::string& newName) const;
+    llvm::RuntimeDyld::SymbolInfo findHostSymbol(const std::string& name);
+    llvm::orc::JITSymbol findSymbolToRun(const std::string& name);
+    std::set<llvm::Function*> partition(llvm::Function& function);
+    void loadHotFunctions();
+    void saveHotFunctions();
+    void unlink();
+
+    std::unique_ptr<llvm::TargetMachine> targetMachine;
+    const llvm::DataLayout dataLayout;
+    String targetKey;
+    ObjectLayer objectLayer;
+    llvm::orc::LocalCXXRuntimeOverrides runtimeOverrides;
+
+    std::map<String, CompiledUnit> units;
+    ObjectLayer::ObjSetHandleT linkedObjects;
+    bool isLinked = false;
+
+    // LAZY LAUNCH
+    CompileLayer compileLayer;
+    std::unique_ptr<llvm::orc::JITCompileCallbackManager> compileCallbackManager;
+    LazyLayer lazyLayer;
+    std::unique_ptr<llvm::LLVMContext> lazyContext;
+    int nextLazyUnitId = 0;
+    LazyLayer::ModuleSetHandleT lazyModules;
+    bool isLazilyLinked = false;
+
+    File hotFunctionsFile;
+    std::set<std::string> hotFunctions;
+    std::set<std::string> reachedFunctions;
+    std::set<const llvm::Module*> modulesWithHotFunctionsCompiled;
+
+    JUCE_DECLARE_NON_COPYABLE(LiveJIT)
+};
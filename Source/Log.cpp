@@ -0,0 +1,301 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#include "Log.h"
+
+#include <memory>
+#include <mutex>
+
+std::atomic<int> AsyncLog::maxLevel { (int) LogLevel::Info };
+std::atomic<uint32> AsyncLog::categories { (uint32) LogCategory::All };
+
+namespace
+{
+    //==============================================================================
+    struct LogRecord
+    {
+        LogLevel level = LogLevel::Info;
+        LogCategory category = LogCategory::General;
+        int64 time = 0;
+        String text;
+    };
+
+    /** Bounded ring where any number of threads push and the writer alone pops.
+        Each slot carries a sequence number telling whose turn it is, so claiming
+        a slot is a single compare-and-swap and no thread ever waits on another.
+    */
+    class LogRing
+    {
+    public:
+        LogRing()
+        {
+            for (size_t i = 0; i < capacity; i++)
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        bool push(LogRecord&& record)
+        {
+            size_t position = enqueuePosition.load(std::memory_order_relaxed);
+            Slot* slot;
+
+            for (;;)
+            {
+                slot = &slots[position & (capacity - 1)];
+                const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+                const intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+
+                if (difference == 0)
+                {
+                    if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (difference < 0)
+                {
+                    return false; // full
+                }
+                else
+                {
+                    position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->record = std::move(record);
+            slot->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(LogRecord& record)
+        {
+            Slot& slot = slots[dequeuePosition & (capacity - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+                return false;
+
+            record = std::move(slot.record);
+            slot.sequence.store(dequeuePosition + capacity, std::memory_order_release);
+            ++dequeuePosition;
+            return true;
+        }
+
+    private:
+        static const size_t capacity = 4096; // a power of two
+
+        struct Slot
+        {
+            std::atomic<size_t> sequence;
+            LogRecord record;
+        };
+
+        Slot slots[capacity];
+        std::atomic<size_t> enqueuePosition { 0 };
+        size_t dequeuePosition = 0;
+    };
+
+    //==============================================================================
+    const char* getCategoryName(LogCategory category)
+    {
+        switch (category)
+        {
+            case LogCategory::General:  return "general";
+            case LogCategory::Messages: return "messages";
+            case LogCategory::Build:    return "build";
+            case LogCategory::Cache:    return "cache";
+            case LogCategory::JIT:      return "jit";
+            default:                    return "";
+        }
+    }
+
+    class LogWriterThread : public Thread
+    {
+    public:
+        LogWriterThread(LogRing& ring_, std::atomic<int>& droppedRecords_, const File& logFile_)
+            : Thread("Log Writer"),
+              ring(ring_),
+              droppedRecords(droppedRecords_),
+              logFile(logFile_)
+        {
+        }
+
+        ~LogWriterThread()
+        {
+            stopThread(5000);
+        }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                wait(50);
+                drain();
+            }
+
+            drain();
+        }
+
+    private:
+        void drain()
+        {
+            MemoryOutputStream batch;
+
+            for (LogRecord record; ring.pop(record);)
+            {
+                const Time time(record.time);
+                batch << String::formatted("%02d:%02d:%02d.%03d ", time.getHours(), time.getMinutes(),
+                                                                   time.getSeconds(), time.getMilliseconds())
+                      << "EWIDT"[(int) record.level] << " "
+                      << getCategoryName(record.category) << ": "
+                      << record.text << newLine;
+            }
+
+            if (const int dropped = droppedRecords.exchange(0))
+                batch << "(" << dropped << " log records dropped, the writer fell behind)" << newLine;
+
+            if (batch.getDataSize() == 0)
+                return;
+
+            FileOutputStream output(logFile);
+            if (output.openedOk())
+                output.write(batch.getData(), batch.getDataSize());
+        }
+
+        LogRing& ring;
+        std::atomic<int>& droppedRecords;
+        File logFile;
+    };
+
+    //==============================================================================
+    struct LogState
+    {
+        LogRing ring;
+        std::atomic<int> droppedRecords { 0 };
+
+        std::mutex writerMutex;
+        std::unique_ptr<LogWriterThread> writer;
+        AsyncLogger logger;
+    };
+
+    LogState& getLogState()
+    {
+        static LogState state;
+        return state;
+    }
+
+    void configureFromEnvironment()
+    {
+        const String setting(SystemStats::getEnvironmentVariable("LIVE_BUILD_LOG", String()).trim().toLowerCase());
+        if (setting.isEmpty())
+            return;
+
+        const StringArray levels(StringArray::fromTokens("error warning info debug trace", false));
+        const int level = levels.indexOf(setting.upToFirstOccurrenceOf(":", false, false).trim());
+        if (level >= 0)
+            AsyncLog::setLevel((LogLevel) level);
+
+        if (setting.containsChar(':'))
+        {
+            uint32 mask = 0;
+            const StringArray names(StringArray::fromTokens(setting.fromFirstOccurrenceOf(":", false, false), ",", String()));
+
+            for (auto& name : names)
+                for (uint32 category = 1; category <= (uint32) LogCategory::JIT; category <<= 1)
+                    if (name.trim() == getCategoryName((LogCategory) category))
+                        mask |= category;
+
+            AsyncLog::setCategories(mask);
+        }
+    }
+}
+
+//==============================================================================
+void AsyncLog::write(LogLevel level, LogCategory category, const String& text)
+{
+    LogRecord record;
+    record.level = level;
+    record.category = category;
+    record.time = Time::currentTimeMillis();
+
+    // whole documents travel in some messages, the log only needs to show what they were
+    if (text.getNumBytesAsUTF8() > (size_t) maxRecordLength)
+    {
+        const int length = text.length();
+        record.text = length > maxRecordLength ? text.substring(0, maxRecordLength) + "... ("
+                                                   + String(length - maxRecordLength) + " more characters)"
+                                               : text;
+    }
+    else
+    {
+        record.text = text;
+    }
+
+    LogState& state = getLogState();
+    if (! state.ring.push(std::move(record)))
+        ++state.droppedRecords;
+}
+
+void AsyncLog::start(const File& logFile, const String& welcomeMessage)
+{
+    configureFromEnvironment();
+
+    LogState& state = getLogState();
+    std::lock_guard<std::mutex> lock(state.writerMutex);
+
+    // what was logged so far goes to the previous file
+    state.writer = nullptr;
+
+    logFile.getParentDirectory().createDirectory();
+    FileLogger::trimFileSize(logFile, 128 * 1024);
+
+    {
+        FileOutputStream output(logFile);
+        if (output.openedOk())
+            output << newLine << "**********************************************************" << newLine
+                   << welcomeMessage << newLine
+                   << "Log started: " << Time::getCurrentTime().toString(true, true) << newLine;
+    }
+
+    state.writer.reset(new LogWriterThread(state.ring, state.droppedRecords, logFile));
+    state.writer->startThread(2);
+
+    Logger::setCurrentLogger(&state.logger);
+}
+
+void AsyncLog::shutdown()
+{
+    LogState& state = getLogState();
+    std::lock_guard<std::mutex> lock(state.writerMutex);
+
+    if (Logger::getCurrentLogger() == &state.logger)
+        Logger::setCurrentLogger(nullptr);
+
+    state.writer = nullptr;
+}
@@ -0,0 +1,126 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <atomic>
+
+//==============================================================================
+enum class LogLevel
+{
+    Error,
+    Warning,
+    Info,
+    Debug,
+    Trace
+};
+
+enum class LogCategory : uint32
+{
+    General     = 1 << 0,
+    Messages    = 1 << 1,   // traffic with the Projucer
+    Build       = 1 << 2,   // compiles and scheduling
+    Cache       = 1 << 3,
+    JIT         = 1 << 4,
+    All         = 0xffffffff
+};
+
+// Levels above this one are compiled out entirely
+#ifndef LIVE_LOG_MAX_LEVEL
+ #define LIVE_LOG_MAX_LEVEL 4
+#endif
+
+//==============================================================================
+/** Logging that never blocks the thread doing the work.
+
+    Records go into a fixed ring of slots that producers claim without locking,
+    a background thread drains it into live.log. When the ring is full a record
+    is dropped and counted rather than waited for. Records of disabled levels or
+    categories are never formatted, checking costs two relaxed loads.
+
+    The level and categories come from the LIVE_BUILD_LOG environment variable,
+    e.g. "debug" or "trace:messages,build", and default to info for everything.
+*/
+class AsyncLog
+{
+public:
+    static bool isEnabled(LogLevel level, LogCategory category) noexcept
+    {
+        return (int) level <= maxLevel.load(std::memory_order_relaxed)
+            && (categories.load(std::memory_order_relaxed) & (uint32) category) != 0;
+    }
+
+    static void write(LogLevel level, LogCategory category, const String& text);
+
+    /** Starts writing to the given file, records written before are kept until then. */
+    static void start(const File& logFile, const String& welcomeMessage);
+
+    /** Writes what is left and stops the writer thread. */
+    static void shutdown();
+
+    static void setLevel(LogLevel level) noexcept                { maxLevel = (int) level; }
+    static void setCategories(uint32 categoryMask) noexcept      { categories = categoryMask; }
+
+    /** Longer payloads, like the text of a whole file, are cut to this many characters. */
+    static const int maxRecordLength = 2048;
+
+private:
+    static std::atomic<int> maxLevel;
+    static std::atomic<uint32> categories;
+};
+
+//==============================================================================
+/** Routes juce::Logger output, DBG included, through the asynchronous log. */
+class AsyncLogger : public Logger
+{
+public:
+    void logMessage(const String& message) override
+    {
+        AsyncLog::write(LogLevel::Info, LogCategory::General, message);
+    }
+};
+
+//==============================================================================
+#define LOG_AT(level, category, x) \
+    do { if ((int) (level) <= LIVE_LOG_MAX_LEVEL && AsyncLog::isEnabled(level, category)) \
+         { String logText_; logText_ << x; AsyncLog::write(level, category, logText_); } } while (false)
+
+#define LOG(x)                      LOG_AT(LogLevel::Info, LogCategory::General, x)
+#define LOG_ERROR(category, x)      LOG_AT(LogLevel::Error, category, x)
+#define LOG_WARNING(category, x)    LOG_AT(LogLevel::Warning, category, x)
+#define LOG_INFO(category, x)       LOG_AT(LogLevel::Info, category, x)
+#define LOG_DEBUG(category, x)      LOG_AT(LogLevel::Debug, category, x)
+#define LOG_TRACE(category, x)      LOG_AT(LogLevel::Trace, category, x)
@@ -36,69 +36,210 @@
 
 #include "Common.h"
 
-#include <queue>
-#include <mutex>
-#include <exception>
+#include <atomic>
 #include <condition_variable>
+#include <mutex>
+#include <utility>
+
+//==============================================================================
+/** Queue any number of threads push to and a single thread consumes.
 
-template<typename T>
+    Pushing never takes a lock, a producer links its node in with one
+    compare-and-swap. The consumer takes everything pushed so far in a single
+    exchange and keeps it in a private list it pops from, so it doesn't touch
+    the shared state once per item. The condition variable is only involved
+    when the consumer is actually asleep.
+
+    With a capacity, pushes beyond it are refused and counted, so callers can
+    see when they produce faster than the consumer keeps up.
+*/
+template <typename T>
 class SharedQueue
 {
 public:
-    SharedQueue() = default;
+    /** A capacity of zero means unbounded. */
+    explicit SharedQueue(size_t maxSize = 0)
+        : capacity(maxSize)
+    {
+    }
 
-    void push(T value)
+    ~SharedQueue()
     {
-		{
-			std::lock_guard<std::mutex> lock(mutex);
-			objectQueue.push(value);
-		}
+        deleteList(head.exchange(nullptr));
+        deleteList(pending);
+    }
 
-		conditionVariable.notify_one();
-	}
+    struct Statistics
+    {
+        uint64 numPushed;
+        uint64 numRejected;
+        size_t highWaterMark;
+    };
 
-	bool tryAndPop(T& returnValue)
+    /** Any thread, returns false if the queue is full. */
+    bool push(T&& value)
     {
-		std::lock_guard<std::mutex> lock(mutex);
+        const size_t newSize = ++numItems;
+        if (capacity > 0 && newSize > capacity)
+        {
+            --numItems;
+            ++numRejected;
+            return false;
+        }
+
+        ++numPushed;
 
-        if (objectQueue.empty())
+        for (size_t mark = highWaterMark.load(std::memory_order_relaxed); newSize > mark;)
+            if (highWaterMark.compare_exchange_weak(mark, newSize, std::memory_order_relaxed))
+                break;
+
+        Node* node = new Node(std::move(value));
+        node->next = head.load(std::memory_order_relaxed);
+        while (! head.compare_exchange_weak(node->next, node))
         {
-			return false;
-		}
+        }
 
-        returnValue = objectQueue.front();
-		objectQueue.pop();
+        if (consumerWaiting.load())
+        {
+            std::lock_guard<std::mutex> lock(waitMutex);
+            wakeUp.notify_one();
+        }
 
         return true;
-	}
+    }
 
-	void waitAndPop(T& returnValue)
+    /** Consumer only. */
+    bool tryAndPop(T& returnValue)
     {
-		std::unique_lock<std::mutex> lock(mutex);
+        if (pending == nullptr)
+            takePushed();
 
-        conditionVariable.wait(lock, [&]() {
-            return ! objectQueue.empty();
-        });
+        if (pending == nullptr)
+            return false;
 
-		returnValue = objectQueue.front();
-		objectQueue.pop();
-	}
+        Node* node = pending;
+        pending = node->next;
 
-	bool empty() const
+        returnValue = std::move(node->value);
+        delete node;
+        --numItems;
+
+        return true;
+    }
+
+    /** Consumer only, blocks until something was pushed. */
+    void waitAndPop(T& returnValue)
+    {
+        while (! tryAndPop(returnValue))
+            waitForItems();
+    }
+
+    /** Consumer only, moves everything queued into the container in the order it was pushed. */
+    template <typename Container>
+    size_t drainInto(Container& destination)
     {
-		std::lock_guard<std::mutex> lock(mutex);
+        takePushed();
+
+        size_t numDrained = 0;
+        while (Node* node = pending)
+        {
+            pending = node->next;
+            destination.push_back(std::move(node->value));
+            delete node;
+            ++numDrained;
+        }
+
+        numItems -= numDrained;
+        return numDrained;
+    }
+
+    /** Consumer only, blocks until something was pushed and then drains it all. */
+    template <typename Container>
+    size_t waitAndDrainInto(Container& destination)
+    {
+        for (;;)
+        {
+            if (const size_t numDrained = drainInto(destination))
+                return numDrained;
+
+            waitForItems();
+        }
+    }
 
-		return objectQueue.empty();
-	}
+    bool empty() const noexcept     { return numItems.load() == 0; }
+    size_t size() const noexcept    { return numItems.load(); }
 
-    std::size_t size() const
+    Statistics getStatistics() const noexcept
     {
-		std::lock_guard<std::mutex> lock(mutex);
-		return objectQueue.size();
-	}
+        return { numPushed.load(), numRejected.load(), highWaterMark.load() };
+    }
 
 private:
-    mutable std::mutex mutex;
-    std::queue<T> objectQueue;
-    std::condition_variable conditionVariable;
+    struct Node
+    {
+        explicit Node(T&& v) : value(std::move(v)) {}
+
+        T value;
+        Node* next = nullptr;
+    };
+
+    /** Moves the pushed nodes behind the private ones, the shared list is newest first. */
+    void takePushed()
+    {
+        Node* node = head.exchange(nullptr, std::memory_order_acquire);
+        if (node == nullptr)
+            return;
+
+        Node* reversed = nullptr;
+        while (node != nullptr)
+        {
+            Node* next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+
+        Node** tail = &pending;
+        while (*tail != nullptr)
+            tail = &(*tail)->next;
+
+        *tail = reversed;
+    }
+
+    void waitForItems()
+    {
+        std::unique_lock<std::mutex> lock(waitMutex);
+
+        // producers look at the flag after linking their node, either they see it
+        // and notify under the lock, or the check below already sees their node
+        consumerWaiting = true;
+        wakeUp.wait(lock, [this] { return head.load() != nullptr; });
+        consumerWaiting = false;
+    }
+
+    static void deleteList(Node* node)
+    {
+        while (node != nullptr)
+        {
+            Node* next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    const size_t capacity;
+
+    std::atomic<Node*> head { nullptr };
+    Node* pending = nullptr;
+
+    std::atomic<size_t> numItems { 0 };
+    std::atomic<uint64> numPushed { 0 };
+    std::atomic<uint64> numRejected { 0 };
+    std::atomic<size_t> highWaterMark { 0 };
+
+    std::atomic<bool> consumerWaiting { false };
+    std::mutex waitMutex;
+    std::condition_variable wakeUp;
+
+    JUCE_DECLARE_NON_COPYABLE(SharedQueue)
 };
@@ -0,0 +1,211 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#include "ValueTreeView.h"
+
+namespace
+{
+    // markers of juce::var in its binary form
+    enum VarMarker
+    {
+        varMarker_Int       = 1,
+        varMarker_BoolTrue  = 2,
+        varMarker_BoolFalse = 3,
+        varMarker_Double    = 4,
+        varMarker_String    = 5,
+        varMarker_Int64     = 6
+    };
+}
+
+//==============================================================================
+struct ValueTreeView::Reader
+{
+    const uint8* position;
+    const uint8* end;
+
+    bool readCompressedInt(int& value)
+    {
+        if (position >= end)
+            return false;
+
+        const uint8 sizeByte = *position++;
+        const int numBytes = sizeByte & 0x7f;
+
+        if (numBytes > 4 || end - position < numBytes)
+            return false;
+
+        uint32 number = 0;
+        for (int i = 0; i < numBytes; i++)
+            number |= ((uint32) position[i]) << (8 * i);
+
+        position += numBytes;
+        value = (sizeByte & 0x80) != 0 ? -(int) number : (int) number;
+        return true;
+    }
+
+    bool readString(const char*& text, size_t& length)
+    {
+        const uint8* const terminator = static_cast<const uint8*>(memchr(position, 0, (size_t) (end - position)));
+        if (terminator == nullptr)
+            return false;
+
+        text = reinterpret_cast<const char*>(position);
+        length = (size_t) (terminator - position);
+        position = terminator + 1;
+        return true;
+    }
+};
+
+//==============================================================================
+ValueTreeView::ValueTreeView(const void* data, size_t size)
+{
+    Reader reader { static_cast<const uint8*>(data), static_cast<const uint8*>(data) + size };
+    valid = parse(reader);
+}
+
+bool ValueTreeView::parse(Reader& reader)
+{
+    if (! reader.readString(type, typeLength))
+        return false;
+
+    int numProperties;
+    if (! reader.readCompressedInt(numProperties) || numProperties < 0)
+        return false;
+
+    properties.reserve((size_t) numProperties);
+
+    for (int i = 0; i < numProperties; i++)
+    {
+        Property property;
+        int valueSize;
+
+        if (! reader.readString(property.name, property.nameLength)
+            || ! reader.readCompressedInt(valueSize)
+            || valueSize < 0
+            || reader.end - reader.position < valueSize)
+            return false;
+
+        // a void var is written as a zero size without a marker
+        property.marker = valueSize > 0 ? reader.position[0] : 0;
+        property.value = valueSize > 0 ? reader.position + 1 : reader.position;
+        property.valueSize = valueSize > 0 ? (size_t) valueSize - 1 : 0;
+
+        reader.position += valueSize;
+        properties.push_back(property);
+    }
+
+    int numChildren;
+    if (! reader.readCompressedInt(numChildren) || numChildren < 0)
+        return false;
+
+    children.resize((size_t) numChildren);
+
+    for (auto& child : children)
+    {
+        child.valid = child.parse(reader);
+        if (! child.valid)
+            return false;
+    }
+
+    return true;
+}
+
+//==============================================================================
+bool ValueTreeView::nameEquals(const char* text, size_t length, const Identifier& name) noexcept
+{
+    const String& nameString = name.toString();
+    return nameString.getNumBytesAsUTF8() == length && memcmp(nameString.toRawUTF8(), text, length) == 0;
+}
+
+bool ValueTreeView::hasType(const Identifier& typeToCompare) const noexcept
+{
+    return valid && nameEquals(type, typeLength, typeToCompare);
+}
+
+const ValueTreeView::Property* ValueTreeView::findProperty(const Identifier& name) const noexcept
+{
+    for (auto& property : properties)
+        if (nameEquals(property.name, property.nameLength, name))
+            return &property;
+
+    return nullptr;
+}
+
+bool ValueTreeView::getStringProperty(const Identifier& name, const char*& text, size_t& numBytes) const noexcept
+{
+    const Property* property = findProperty(name);
+    if (property == nullptr || property->marker != varMarker_String || property->valueSize == 0)
+        return false;
+
+    // the string is written with its terminator
+    text = reinterpret_cast<const char*>(property->value);
+    numBytes = property->valueSize - 1;
+    return text[numBytes] == 0;
+}
+
+String ValueTreeView::getStringProperty(const Identifier& name) const
+{
+    const char* text;
+    size_t numBytes;
+
+    if (! getStringProperty(name, text, numBytes))
+        return String();
+
+    return String::fromUTF8(text, (int) numBytes);
+}
+
+int ValueTreeView::getIntProperty(const Identifier& name, int defaultValue) const noexcept
+{
+    const Property* property = findProperty(name);
+    if (property == nullptr)
+        return defaultValue;
+
+    switch (property->marker)
+    {
+        case varMarker_Int:
+            return property->valueSize >= 4 ? (int) ByteOrder::littleEndianInt(property->value) : defaultValue;
+
+        case varMarker_Int64:
+            return property->valueSize >= 8 ? (int) ByteOrder::littleEndianInt64(property->value) : defaultValue;
+
+        case varMarker_BoolTrue:
+            return 1;
+
+        case varMarker_BoolFalse:
+            return 0;
+
+        default:
+            return defaultValue;
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ ==============================================================================
+
+ - JUCECompileEngine - Copyright (c) 2016, Lucio Asnaghi
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ 3. Neither the name of the copyright holder nor the names of its contributors
+ may be used to endorse or promote products derived from this software without
+ specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ ==============================================================================
+ */
+
+#pragma once
+
+#include "Common.h"
+
+#include <vector>
+
+//==============================================================================
+/** Read-only view of a ValueTree in the binary form written by ValueTree::writeToStream.
+
+    Nothing is decoded up front and nothing is copied, names and string values
+    point straight into the data, which has to outlive the view. Used for the
+    messages that carry whole documents, where building a ValueTree would copy
+    the text several times before it reaches the compiler.
+*/
+class ValueTreeView
+{
+public:
+    ValueTreeView() = default;
+    ValueTreeView(const void* data, size_t size);
+
+    /** False if the data is truncated or not a ValueTree. */
+    bool isValid() const noexcept { return valid; }
+
+    bool hasType(const Identifier& type) const noexcept;
+
+    /** Finds a string property, the text is null terminated and numBytes excludes the terminator. */
+    bool getStringProperty(const Identifier& name, const char*& text, size_t& numBytes) const noexcept;
+    String getStringProperty(const Identifier& name) const;
+    int getIntProperty(const Identifier& name, int defaultValue) const noexcept;
+
+    int getNumChildren() const noexcept { return (int) children.size(); }
+    const ValueTreeView& getChild(int index) const noexcept { return children[(size_t) index]; }
+
+private:
+    struct Reader;
+
+    struct Property
+    {
+        const char* name;
+        size_t nameLength;
+        uint8 marker;
+        const uint8* value;
+        size_t valueSize;
+    };
+
+    bool parse(Reader& reader);
+    const Property* findProperty(const Identifier& name) const noexcept;
+    static bool nameEquals(const char* text, size_t length, const Identifier& name) noexcept;
+
+    const char* type = nullptr;
+    size_t typeLength = 0;
+    std::vector<Property> properties;
+    std::vector<ValueTreeView> children;
+    bool valid = false;
+};
@@ -34,6 +34,7 @@
 
 #include "Common.h"
 #include "LiveCodeBuilder.h"
+#include "ValueTreeView.h"
 
 //==============================================================================
 extern "C" {
@@ -45,6 +46,15 @@ GetPropertyFunction getPropertyFunction = nullptr;
 bool runningAsChildProcess = false;
 bool loggedIn = true;
 
+//==============================================================================
+static void logMessage(const char* name, const void* messageData, size_t messageDataSize)
+{
+	LOG_INFO(LogCategory::Messages, name);
+
+	// the tree is only decoded when the debug level is on
+	LOG_DEBUG(LogCategory::Messages, ValueTree::readFromData(messageData, messageDataSize).toXmlString());
+}
+
 //==============================================================================
 JUCE_API void projucer_sendMessage(LiveCodeBuilder lcb,
 								   const void* messageData,
@@ -54,103 +64,109 @@ JUCE_API void projucer_sendMessage(LiveCodeBuilder lcb,
 
 	LiveCodeBuilderImpl* liveCodeBuilder = static_cast<LiveCodeBuilderImpl*>(lcb);
 
-	ValueTree message = ValueTree::readFromData(messageData, messageDataSize);
+	static const Identifier fileId("file");
+	static const Identifier textId("text");
+	static const Identifier startId("start");
+	static const Identifier endId("end");
+	static const Identifier parentActiveId("parentActive");
 
-	if (message.getType() == MessageTypes::BUILDINFO)
-	{
-		LOG("BUILDINFO");
-		LOG(message.toXmlString());
+	// Messages carrying document text are read in place, the text is copied
+	// once into the buffer the document and the compiler share
+	const ValueTreeView view(messageData, messageDataSize);
 
-		liveCodeBuilder->setBuildInfo(message);
-	}
-	else if (message.getType() == MessageTypes::LIVE_FILE_UPDATE)
+	if (view.hasType(MessageTypes::LIVE_FILE_UPDATE))
 	{
-		LOG("LIVE_FILE_UPDATE");
-		LOG(message.toXmlString());
+		logMessage("LIVE_FILE_UPDATE", messageData, messageDataSize);
+
+		const char* text = "";
+		size_t numBytes = 0;
+		view.getStringProperty(textId, text, numBytes);
 
-		liveCodeBuilder->fileUpdated(message.getProperty("file").toString(),
-									 message.getProperty("text").toString());
+		liveCodeBuilder->fileUpdated(view.getStringProperty(fileId),
+									 new SourceBuffer(text, numBytes));
+		return;
 	}
-	else if (message.getType() == MessageTypes::LIVE_FILE_CHANGES)
+
+	if (view.hasType(MessageTypes::LIVE_FILE_CHANGES))
 	{
-		LOG("LIVE_FILE_CHANGES");
-		LOG(message.toXmlString());
+		logMessage("LIVE_FILE_CHANGES", messageData, messageDataSize);
 
 		Array<LiveCodeChange> changes;
-		for (int i = 0; i < message.getNumChildren(); i++)
+		for (int i = 0; i < view.getNumChildren(); i++)
 		{
-			ValueTree child = message.getChild(i);
+			const ValueTreeView& child = view.getChild(i);
 			if (child.hasType(MessageTypes::CHANGE))
 			{
-				LiveCodeChange change;
-				change.start = (int)child.getProperty("start", 0);
-				change.end = (int)child.getProperty("end", 0);
-				change.text = child.getProperty("text", "");
+				LiveCodeChange change = { child.getIntProperty(startId, 0), child.getIntProperty(endId, 0), "", 0 };
+				child.getStringProperty(textId, change.text, change.numBytes);
 				changes.add(change);
 			}
 		}
 
-		liveCodeBuilder->fileChanged(message.getProperty("file").toString(),
+		liveCodeBuilder->fileChanged(view.getStringProperty(fileId),
 									 changes);
+		return;
+	}
+
+	// the build info is the only message read as a whole, the others carry a property or two at most
+	if (view.hasType(MessageTypes::BUILDINFO))
+	{
+		const ValueTree message(ValueTree::readFromData(messageData, messageDataSize));
+
+		LOG_INFO(LogCategory::Messages, "BUILDINFO");
+		LOG_DEBUG(LogCategory::Messages, message.toXmlString());
+
+		liveCodeBuilder->setBuildInfo(message);
 	}
-	else if (message.getType() == MessageTypes::LIVE_FILE_RESET)
+	else if (view.hasType(MessageTypes::LIVE_FILE_RESET))
 	{
-		LOG("LIVE_FILE_RESET");
-		LOG(message.toXmlString());
+		logMessage("LIVE_FILE_RESET", messageData, messageDataSize);
 
-		liveCodeBuilder->fileReset(message.getProperty("file").toString());
+		liveCodeBuilder->fileReset(view.getStringProperty(fileId));
 	}
-	else if (message.getType() == MessageTypes::CLEAN_ALL)
+	else if (view.hasType(MessageTypes::CLEAN_ALL))
 	{
-		LOG("CLEAN_ALL");
-		LOG(message.toXmlString());
+		logMessage("CLEAN_ALL", messageData, messageDataSize);
 
 		liveCodeBuilder->cleanAll();
 	}
-	else if (message.getType() == MessageTypes::RELOAD)
+	else if (view.hasType(MessageTypes::RELOAD))
 	{
-		LOG("RELOAD");
-		LOG(message.toXmlString());
+		logMessage("RELOAD", messageData, messageDataSize);
 
 		liveCodeBuilder->reloadComponents();
 	}
-	else if (message.getType() == MessageTypes::OPEN_PREVIEW)
+	else if (view.hasType(MessageTypes::OPEN_PREVIEW))
 	{
-		LOG("OPEN_PREVIEW");
-		LOG(message.toXmlString());
+		logMessage("OPEN_PREVIEW", messageData, messageDataSize);
 	}
-	else if (message.getType() == MessageTypes::LAUNCH_APP)
+	else if (view.hasType(MessageTypes::LAUNCH_APP))
 	{
-		LOG("LAUNCH_APP");
-		LOG(message.toXmlString());
+		logMessage("LAUNCH_APP", messageData, messageDataSize);
 
 		liveCodeBuilder->launchApp();
 	}
-	else if (message.getType() == MessageTypes::FOREGROUND)
+	else if (view.hasType(MessageTypes::FOREGROUND))
 	{
-		LOG("FOREGROUND");
-		LOG(message.toXmlString());
+		logMessage("FOREGROUND", messageData, messageDataSize);
 
-		liveCodeBuilder->foregroundProcess((int)message.getProperty("parentActive") == 1);
+		liveCodeBuilder->foregroundProcess(view.getIntProperty(parentActiveId, 0) == 1);
 	}
-	else if (message.getType() == MessageTypes::PING)
+	else if (view.hasType(MessageTypes::PING))
 	{
-		LOG("PING");
-		LOG(message.toXmlString());
+		logMessage("PING", messageData, messageDataSize);
 
 		liveCodeBuilder->pong();
 	}
-	else if (message.getType() == MessageTypes::QUIT_SERVER)
+	else if (view.hasType(MessageTypes::QUIT_SERVER))
 	{
-		LOG("QUIT_SERVER");
-		LOG(message.toXmlString());
+		logMessage("QUIT_SERVER", messageData, messageDataSize);
 
 		//liveCodeBuilder->pong();
 	}
 	else
 	{
-		LOG("projucer_sendMessage");
-		LOG(message.toXmlString());
+		logMessage("projucer_sendMessage", messageData, messageDataSize);
 	}
 }
 
@@ -180,6 +196,8 @@ JUCE_API void projucer_initialise(CrashCallbackFunction crashCallback,
 JUCE_API void projucer_shutdown()
 {
 	LOG("projucer_shutdown");
+
+	AsyncLog::shutdown();
 }
 
 //==========================================================================
@@ -195,8 +213,8 @@ JUCE_API LiveCodeBuilder projucer_createBuilder(SendMessageFunction sendFunction
 																			   projectID,
 																			   cacheFolder));
 
-	Logger::setCurrentLogger(new FileLogger(File(cacheFolder).getChildFile("live.log"),
-											"Welcome to unofficial Live Code Builder 4 Projucer"));
+	AsyncLog::start(File(cacheFolder).getChildFile("live.log"),
+					"Welcome to unofficial Live Code Builder 4 Projucer");
 
 	return (void*)liveCodeBuilder.release();
 }